@@ -17,31 +17,35 @@
   c -= a; c -= b; c ^= (b>>15); \
 }
 
-template<size_t len, uint32_t seed>
-uint32_t BOB(const void * buf)
+// BOB hash of a key whose length is known at compile time, the 12-byte rounds and the tail
+// switch are resolved by the compiler, so 8, 13 and 16-byte keys all get straight-line code.
+// Always inlined: the unrolled probe loops of the Bloom filters call it k times per key
+// and the inliner would otherwise stop part way through them.
+template<size_t len>
+__attribute__((always_inline)) inline uint32_t BOB_fixed(const void * buf, uint32_t seed)
 {
     const char * str = (const char *)buf;
     //register ub4 a,b,c,len;
     unsigned int a,b,c;
     unsigned int initval = seed;
     /* Set up the internal state */
-    //len = length;
     a = b = 0x9e3779b9;  /* the golden ratio; an arbitrary value */
     c = initval;         /* the previous hash value */
 
     /*---------------------------------------- handle most of the key */
-//    while (len >= 12)
-//    {
-//        a += (str[0] +((unsigned int)str[1]<<8) +((unsigned int)str[2]<<16) +((unsigned int)str[3]<<24));
-//        b += (str[4] +((unsigned int)str[5]<<8) +((unsigned int)str[6]<<16) +((unsigned int)str[7]<<24));
-//        c += (str[8] +((unsigned int)str[9]<<8) +((unsigned int)str[10]<<16)+((unsigned int)str[11]<<24));
-//        mix(a,b,c);
-//        str += 12; len -= 12;
-//    }
+    for (size_t i = 0; i < len / 12; ++i)
+    {
+        a += (str[0] +((unsigned int)str[1]<<8) +((unsigned int)str[2]<<16) +((unsigned int)str[3]<<24));
+        b += (str[4] +((unsigned int)str[5]<<8) +((unsigned int)str[6]<<16) +((unsigned int)str[7]<<24));
+        c += (str[8] +((unsigned int)str[9]<<8) +((unsigned int)str[10]<<16)+((unsigned int)str[11]<<24));
+        mix(a,b,c);
+        str += 12;
+    }
 
     /*------------------------------------- handle the last 11 bytes */
-    c += len;
-    switch(len)              /* all the case statements fall through */
+    constexpr size_t tail = len % 12;
+    c += tail;
+    switch(tail)              /* all the case statements fall through */
     {
     case 11: c+=((unsigned int)str[10]<<24);
         // fall through
@@ -75,6 +79,12 @@ uint32_t BOB(const void * buf)
     return c;
 }
 
+template<size_t len, uint32_t seed>
+uint32_t BOB(const void * buf)
+{
+    return BOB_fixed<len>(buf, seed);
+}
+
 template<uint32_t seed>
 uint32_t BOB_str(const void * buf, size_t len)
 {
@@ -142,7 +152,14 @@ public:
     {
     }
 
-    uint32_t run(const void * buf, size_t len)
+    // every byte of a fixed-width key, with code specialized on its length
+    template<size_t len>
+    uint32_t run(const void * buf) const
+    {
+        return BOB_fixed<len>(buf, seed);
+    }
+
+    uint32_t run(const void * buf, size_t len) const
     {
         const char * str = (const char *)buf;
         //register ub4 a,b,c,len;
@@ -200,6 +217,57 @@ public:
     }
 };
 
+// one pass over the key giving two 32-bit hashes (c and b of the final mix), like hashlittle2
+inline void BOB_pair(const void * buf, size_t len, uint32_t seed1, uint32_t seed2, uint32_t & h1, uint32_t & h2)
+{
+    const char * str = (const char *)buf;
+    unsigned int a,b,c;
+    a = b = 0x9e3779b9;  /* the golden ratio; an arbitrary value */
+    c = seed1;
+    b += seed2;
+
+    while (len >= 12)
+    {
+        a += (str[0] +((unsigned int)str[1]<<8) +((unsigned int)str[2]<<16) +((unsigned int)str[3]<<24));
+        b += (str[4] +((unsigned int)str[5]<<8) +((unsigned int)str[6]<<16) +((unsigned int)str[7]<<24));
+        c += (str[8] +((unsigned int)str[9]<<8) +((unsigned int)str[10]<<16)+((unsigned int)str[11]<<24));
+        mix(a,b,c);
+        str += 12; len -= 12;
+    }
+
+    c += len;
+    switch(len)              /* all the case statements fall through */
+    {
+    case 11: c+=((unsigned int)str[10]<<24);
+        // fall through
+    case 10: c+=((unsigned int)str[9]<<16);
+        // fall through
+    case 9 : c+=((unsigned int)str[8]<<8);
+        // fall through
+    case 8 : b+=((unsigned int)str[7]<<24);
+        // fall through
+    case 7 : b+=((unsigned int)str[6]<<16);
+        // fall through
+    case 6 : b+=((unsigned int)str[5]<<8);
+        // fall through
+    case 5 : b+=str[4];
+        // fall through
+    case 4 : a+=((unsigned int)str[3]<<24);
+        // fall through
+    case 3 : a+=((unsigned int)str[2]<<16);
+        // fall through
+    case 2 : a+=((unsigned int)str[1]<<8);
+        // fall through
+    case 1 : a+=str[0];
+        // fall through
+    default:
+        break;
+    }
+    mix(a,b,c);
+    h1 = c;
+    h2 = b;
+}
+
 uint32_t (*BOB1_str)(const void * buf, size_t len) = BOB_str<0x01a725e4>;
 uint32_t (*BOB2_str)(const void * buf, size_t len) = BOB_str<0xb7a2fb64>;
 
@@ -237,6 +305,20 @@ uint32_t (*BOB30)(const void * buf) = BOB<8, 0x33fecdec>;
 uint32_t (*BOB31)(const void * buf) = BOB<8, 0x65dc2ced>;
 uint32_t (*BOB32)(const void * buf) = BOB<8, 0x552ee399>;
 
+// seeds of BOB1 ... BOB32, BOB_n<len>(i, key) is BOB_hashs[i] for keys of len bytes
+static const uint32_t BOB_seeds[] = {
+        0x01a725e4, 0xb7a2fb64, 0x9574726c, 0xe1b60a3c, 0x251738e4, 0x7940f935, 0xf47b3921, 0x79aaa783,
+        0x8aa403ae, 0x899fb734, 0xd612d7e0, 0xa966dba1, 0xc4745645, 0x07fd50b7, 0x34b31b48, 0xe3b734e8,
+        0x5ccb3998, 0x399665fd, 0x7c5831bb, 0x3f5fb74e, 0x55149568, 0x2f0329f4, 0x09e1eb15, 0x40937258,
+        0x028b72f2, 0x649f472a, 0x4dd337fc, 0x6a5ea1c5, 0x4759ca2b, 0x33fecdec, 0x65dc2ced, 0x552ee399,
+};
+
+template<size_t len>
+__attribute__((always_inline)) inline uint32_t BOB_n(int i, const void * buf)
+{
+    return BOB_fixed<len>(buf, BOB_seeds[i]);
+}
+
 uint32_t (*BOB_hashs[])(const void * buf) = {
         BOB1, BOB2, BOB3, BOB4, BOB5, BOB6, BOB7, BOB8,
         BOB9, BOB10, BOB11, BOB12, BOB13, BOB14, BOB15, BOB16,
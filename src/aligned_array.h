@@ -0,0 +1,72 @@
+#ifndef COLORINGCLASSIFER_ALIGNED_ARRAY_H
+#define COLORINGCLASSIFER_ALIGNED_ARRAY_H
+
+#include <utility>
+#include "huge_page_alloc.h"
+
+using namespace std;
+
+// Zeroed, cache-line aligned heap array of trivially copyable T, sized at run time.
+// The storage comes from huge_alloc: arrays of 2 MB and more are mapped on (transparent)
+// huge pages, are only touched when used and go back to the OS on destruction.
+template<typename T>
+class AlignedArray
+{
+    T * ptr;
+    size_t num;
+    size_t bytes;
+
+public:
+    explicit AlignedArray(size_t _num) : ptr(NULL), num(_num), bytes((_num * sizeof(T) + 63) / 64 * 64)
+    {
+        ptr = (T *)huge_alloc(bytes);
+    }
+
+    AlignedArray(const AlignedArray &) = delete;
+    AlignedArray & operator=(const AlignedArray &) = delete;
+
+    void swap(AlignedArray & other)
+    {
+        std::swap(ptr, other.ptr);
+        std::swap(num, other.num);
+        std::swap(bytes, other.bytes);
+    }
+
+    ~AlignedArray()
+    {
+        huge_free(ptr, bytes);
+    }
+
+    inline T & operator[](size_t i)
+    {
+        return ptr[i];
+    }
+
+    inline const T & operator[](size_t i) const
+    {
+        return ptr[i];
+    }
+
+    T * data()
+    {
+        return ptr;
+    }
+
+    const T * data() const
+    {
+        return ptr;
+    }
+
+    size_t size() const
+    {
+        return num;
+    }
+
+    // bytes reserved, including the padding to a whole cache line
+    size_t size_bytes() const
+    {
+        return bytes;
+    }
+};
+
+#endif //COLORINGCLASSIFER_ALIGNED_ARRAY_H
@@ -0,0 +1,362 @@
+// Throughput / latency benchmark of the static engines, built as the `bench` target (-O3, no -pg).
+//
+//   bench [csv|json] [perf] [keys]
+//
+// Every engine gets the same keys through the duck interface build / query / insert / name:
+// `keys` distinct uint64 keys from workload.h (default 1M, at most max_keys) with class i % 2, built at once,
+// then 1% more (at most max_inserts) inserted one by one where the engine supports it. All seeds are fixed, so two
+// runs on the same machine see the same keys, probes and hash functions.
+// The engines are sized at compile time for the smallest tier in size_tiers that holds the keys,
+// reported as sized_for. bits_per_key divides the engine as sized by the keys it holds, so it grows
+// as the keys fall below the tier; sized_bits_per_key divides by sized_for, the density it was built for.
+// Reported per engine: bits per key (query arrays and overflow table; all of memory_usage() in
+// total_bits_per_key), peak RSS of construction and build above what was resident before, build Mkeys/s, query ns/op for class-1 members (pos),
+// class-0 members (neg), keys never inserted (alien) and a production-like mix (Zipf 0.99 over
+// the members, 10% aliens), inserts/s, the member error rate and
+// the share of alien keys that got a class (the filters can answer "none", -2, the others can not).
+// With `perf`, also the perf counters of the build per key and of the query passes per query
+// (cycles, instructions, LLC / dTLB / branch misses; software counters where there is no PMU).
+// Only the results go to stdout, the progress prints of the engines are sent to stderr.
+
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include "coloring_classifier.h"
+#include "shift_coloring_classifier.h"
+#include "multi_bloom_filter.h"
+#include "coded_bloom_filter.h"
+#include "shifting_bloom_filter.h"
+#include "xor_retrieval.h"
+#include "perf_counters.h"
+#include "workload.h"
+#include "memory_usage.h"
+
+using namespace std;
+
+// template sizes are fixed per tier, `keys` on the command line picks the tier and can not exceed the last
+constexpr int size_tiers[] = {1 << 14, 1 << 15, 1 << 16, 1 << 17, 1 << 18, 1 << 19, 1 << 20};
+constexpr int size_tier_num = sizeof(size_tiers) / sizeof(size_tiers[0]);
+constexpr int max_keys = size_tiers[size_tier_num - 1];
+constexpr int bits_per_key = 10;
+constexpr int bf_k = 7;
+constexpr uint64_t data_seed = 41;
+constexpr int repeat = 3;
+// an insert into the classifiers is O(bucket_num), more would only stretch the run
+constexpr int max_inserts = 100;
+
+struct BenchResult
+{
+    string engine;
+    int class_num;
+    int keys;
+    int sized_for;
+    bool build_ok;
+    double bits_per_key;
+    double sized_bits_per_key;
+    double total_bits_per_key;
+    double build_peak_mb;
+    double build_mkeys;
+    double pos_ns, neg_ns, alien_ns, mix_ns;
+    double insert_ops;   // NaN where the engine can not insert
+    double error_rate;
+    double alien_accept;
+    PerfSample build_perf;   // per key built
+    PerfSample query_perf;   // all timed query passes, per query
+    double query_ops;
+};
+
+struct Workload
+{
+    KVList data;                  // [0, build_num) built, [build_num, size) inserted
+    int build_num;
+    vector<uint64_t> pos, neg, alien, mix;
+};
+
+Workload make_workload(int num)
+{
+    Workload w;
+    w.build_num = num;
+    int insert_num = min(num / 100, max_inserts);
+    WorkloadSpec spec;
+    spec.seed = data_seed;
+    WorkloadGenerator gen(spec);
+    w.data = gen.kvs(num + insert_num);
+    w.alien = gen.aliens(num);
+    QueryMix mix;
+    mix.dist = QUERIES_ZIPF;
+    mix.zipf_s = 0.99;
+    mix.hit_rate = 0.9;
+    w.mix = gen.queries(num, num, mix);
+    mt19937_64 rng(data_seed);
+    for (int i = 0; i < num; ++i) {
+        (w.data[i].second ? w.pos : w.neg).push_back(w.data[i].first);
+    }
+    shuffle(w.pos.begin(), w.pos.end(), rng);
+    shuffle(w.neg.begin(), w.neg.end(), rng);
+    return w;
+}
+
+// ColoringClassifier only separates two sets: query() is 1 when both buckets have the same
+// color, which is what insert(key, 0) and set_neg_edge ask for. This gives it the class interface.
+template<int bucket_num>
+class TwoSetClassifier
+{
+    typedef ColoringClassifier<bucket_num, 4> CC;
+    CC * cc;
+public:
+    const string name;
+    constexpr static int _class_num = 2;
+
+    TwoSetClassifier() : cc(new CC(41, 42)), name("CC4-2set") {}
+
+    ~TwoSetClassifier()
+    {
+        delete cc;
+    }
+
+    bool build(KVList & kvs, int num)
+    {
+        vector<uint64_t> pos, neg;
+        for (int i = 0; i < num; ++i) {
+            (kvs[i].second ? pos : neg).push_back(kvs[i].first);
+        }
+        cc->set_pos_edge(pos.data(), pos.size());
+        cc->set_neg_edge(neg.data(), neg.size());
+        return cc->build();
+    }
+
+    bool insert(uint64_t key, int class_id)
+    {
+        return cc->insert(key, class_id);
+    }
+
+    int query(uint64_t key) const
+    {
+        return 1 - cc->query(key);
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        return cc->memory_usage();
+    }
+};
+
+template<typename Engine, typename = void>
+struct can_insert : false_type {};
+
+template<typename Engine>
+struct can_insert<Engine, void_t<decltype(declval<Engine &>().insert(uint64_t(), 0))>> : true_type {};
+
+// best of `repeat` passes over keys, in ns per query; the counters of all passes are added to perf
+template<typename Engine>
+double time_query(Engine * engine, const vector<uint64_t> & keys, PerfSample & perf)
+{
+    PerfCounters & counters = PerfCounters::thread_counters();
+    double best = 1e300;
+    volatile int sink = 0;
+    for (int r = 0; r < repeat; ++r) {
+        int acc = 0;
+        PerfSample p0 = counters.read();
+        auto t0 = chrono::steady_clock::now();
+        for (uint64_t key: keys) {
+            acc += engine->query(key);
+        }
+        auto t1 = chrono::steady_clock::now();
+        perf += counters.read() - p0;
+        sink = sink + acc;
+        best = min(best, chrono::duration<double, nano>(t1 - t0).count() / keys.size());
+    }
+    return best;
+}
+
+// make() allocates the engine, which is deleted at the end
+template<typename Make>
+BenchResult run_engine(Make make, Workload & w, int sized_for)
+{
+    typedef typename remove_pointer<decltype(make())>::type Engine;
+    // the peak of construction and build, the workload is already resident
+    reset_peak_rss();
+    size_t rss0 = current_rss_bytes();
+    Engine * engine = make();
+
+    BenchResult res;
+    res.engine = engine->name;
+    res.class_num = Engine::_class_num;
+    res.keys = w.build_num;
+    res.sized_for = sized_for;
+
+    PerfCounters & counters = PerfCounters::thread_counters();
+    PerfSample p0 = counters.read();
+    auto t0 = chrono::steady_clock::now();
+    res.build_ok = engine->build(w.data, w.build_num);
+    auto t1 = chrono::steady_clock::now();
+    res.build_perf = counters.read() - p0;
+    size_t peak = peak_rss_bytes();
+    res.build_peak_mb = peak > rss0 ? (peak - rss0) / 1048576.0 : 0;
+    res.build_mkeys = w.build_num / chrono::duration<double, micro>(t1 - t0).count();
+
+    res.pos_ns = time_query(engine, w.pos, res.query_perf);
+    res.neg_ns = time_query(engine, w.neg, res.query_perf);
+    res.alien_ns = time_query(engine, w.alien, res.query_perf);
+    res.mix_ns = time_query(engine, w.mix, res.query_perf);
+    res.query_ops = double(repeat) * (w.pos.size() + w.neg.size() + w.alien.size() + w.mix.size());
+
+    int total = w.build_num;
+    res.insert_ops = NAN;
+    if constexpr (can_insert<Engine>::value) {
+        auto t2 = chrono::steady_clock::now();
+        for (size_t i = w.build_num; i < w.data.size(); ++i) {
+            engine->insert(w.data[i].first, w.data[i].second);
+        }
+        auto t3 = chrono::steady_clock::now();
+        res.insert_ops = (w.data.size() - w.build_num) / chrono::duration<double>(t3 - t2).count();
+        total = w.data.size();
+    }
+    MemoryUsage mem = engine->memory_usage();
+    res.bits_per_key = 8.0 * mem.query_total() / total;
+    res.sized_bits_per_key = 8.0 * mem.query_total() / max(sized_for, total);
+    res.total_bits_per_key = 8.0 * mem.total() / total;
+
+    int err_cnt = 0;
+    for (int i = 0; i < total; ++i) {
+        err_cnt += (int(engine->query(w.data[i].first)) != int(w.data[i].second));
+    }
+    res.error_rate = double(err_cnt) / total;
+
+    int accept_cnt = 0;
+    for (uint64_t key: w.alien) {
+        accept_cnt += (int(engine->query(key)) >= 0);
+    }
+    res.alien_accept = double(accept_cnt) / w.alien.size();
+    delete engine;
+    return res;
+}
+
+// one column per event, empty where the event could not be counted
+void print_csv_perf(const PerfSample & perf, double ops)
+{
+    for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+        if (perf.has(PerfEvent(e))) {
+            printf(",%.4g", perf.values[e] / ops);
+        } else {
+            printf(",");
+        }
+    }
+}
+
+void print_csv(const vector<BenchResult> & results, bool perf)
+{
+    printf("engine,class_num,keys,sized_for,build_ok,bits_per_key,sized_bits_per_key,total_bits_per_key,build_peak_mb,build_mkeys_per_s,pos_ns,neg_ns,alien_ns,mix_ns,"
+           "insert_ops_per_s,error_rate,alien_accept");
+    if (perf) {
+        for (const char * stage: {"build", "query"}) {
+            for (auto name: perf_event_names) {
+                printf(",%s_%s", stage, name);
+            }
+        }
+    }
+    printf("\n");
+    for (auto & r: results) {
+        printf("%s,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.1f,%.3f,%.2f,%.2f,%.2f,%.2f,%.0f,%.6f,%.6f", r.engine.c_str(), r.class_num,
+               r.keys, r.sized_for, int(r.build_ok), r.bits_per_key, r.sized_bits_per_key, r.total_bits_per_key, r.build_peak_mb, r.build_mkeys, r.pos_ns, r.neg_ns, r.alien_ns, r.mix_ns, r.insert_ops,
+               r.error_rate, r.alien_accept);
+        if (perf) {
+            print_csv_perf(r.build_perf, r.keys);
+            print_csv_perf(r.query_perf, r.query_ops);
+        }
+        printf("\n");
+    }
+}
+
+void print_json(const vector<BenchResult> & results, bool perf)
+{
+    printf("[\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto & r = results[i];
+        printf("  {\"engine\": \"%s\", \"class_num\": %d, \"keys\": %d, \"sized_for\": %d, \"build_ok\": %s, "
+               "\"bits_per_key\": %.3f, \"sized_bits_per_key\": %.3f, "
+               "\"total_bits_per_key\": %.3f, \"build_peak_mb\": %.1f, \"build_mkeys_per_s\": %.3f, \"pos_ns\": %.2f, \"neg_ns\": %.2f, \"alien_ns\": %.2f, \"mix_ns\": %.2f, ",
+               r.engine.c_str(), r.class_num, r.keys, r.sized_for, r.build_ok ? "true" : "false", r.bits_per_key,
+               r.sized_bits_per_key, r.total_bits_per_key, r.build_peak_mb, r.build_mkeys, r.pos_ns, r.neg_ns, r.alien_ns, r.mix_ns);
+        if (isnan(r.insert_ops)) {
+            printf("\"insert_ops_per_s\": null, ");
+        } else {
+            printf("\"insert_ops_per_s\": %.0f, ", r.insert_ops);
+        }
+        printf("\"error_rate\": %.6f, \"alien_accept\": %.6f", r.error_rate, r.alien_accept);
+        if (perf) {
+            printf(", \"build_perf_per_key\": ");
+            r.build_perf.write_json(stdout, r.keys);
+            printf(", \"query_perf_per_op\": ");
+            r.query_perf.write_json(stdout, r.query_ops);
+        }
+        printf("}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    printf("]\n");
+}
+
+// every engine, sized for the smallest tier from tier_idx on that holds the built keys
+template<int tier_idx>
+void run_tier(Workload & w, vector<BenchResult> & results)
+{
+    if constexpr (tier_idx + 1 < size_tier_num) {
+        if (w.build_num > size_tiers[tier_idx]) {
+            run_tier<tier_idx + 1>(w, results);
+            return;
+        }
+    }
+    constexpr int tier = size_tiers[tier_idx];
+    constexpr int bucket_num = int(tier * 1.25);
+    constexpr int num_bits = bits_per_key * tier;
+
+    results.push_back(run_engine([]() { return new TwoSetClassifier<bucket_num>(); }, w, tier));
+    results.push_back(run_engine([]() { return new ShiftingColoringClassifier<bucket_num, 4, 2>(41, 42); }, w, tier));
+    results.push_back(run_engine([]() { return new MultiBloomFilter<num_bits, bf_k, 2>(); }, w, tier));
+    results.push_back(run_engine([]() { return new CodedBloomFilter<num_bits, bf_k, 2>(); }, w, tier));
+    results.push_back(run_engine([]() { return new ShiftingBloomFilter<num_bits, bf_k, 2>(); }, w, tier));
+    // sized by build()
+    results.push_back(run_engine([]() { return new XorRetrieval<2>(41); }, w, w.build_num));
+}
+
+int main(int argc, char ** argv)
+{
+    bool json = false;
+    bool perf = false;
+    int num = max_keys;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "csv") == 0) {
+            json = false;
+        } else if (strcmp(argv[i], "perf") == 0) {
+            perf = true;
+        } else {
+            num = atoi(argv[i]);
+            if (num <= 0 || num > max_keys) {
+                fprintf(stderr, "keys must be in [1, %d]\n", max_keys);
+                return 1;
+            }
+        }
+    }
+
+    cout.rdbuf(cerr.rdbuf());
+    if (perf) {
+        fprintf(stderr, "perf counters: %s\n", PerfCounters::thread_counters().source());
+    }
+    Workload w = make_workload(num);
+    vector<BenchResult> results;
+    run_tier<0>(w, results);
+
+    if (json) {
+        print_json(results, perf);
+    } else {
+        print_csv(results, perf);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef COLORINGCLASSIFER_BLOOM_HASH_H
+#define COLORINGCLASSIFER_BLOOM_HASH_H
+
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include "BOB_hash.h"
+
+using namespace std;
+
+// Probe positions of a key for the Bloom filters, before the modulo.
+//   default:        probe i is BOB_n(i, key), one full BOB mix per probe
+//   double_hashing: one BOB pass gives h1 and h2, probe i is h1 + i * h2 + (i^3 - i) / 6 mod 2^32
+//                   (Kirsch-Mitzenmacher with the enhanced double hashing correction)
+// Probes stay 32-bit so that ProbeHash8 in bloom_simd.h computes the same ones in AVX2 lanes.
+template<typename Key, int k, bool double_hashing>
+class ProbeHash
+{
+    const Key & key;
+    uint32_t h1, h2;
+public:
+    explicit ProbeHash(const Key & _key) : key(_key), h1(0), h2(0)
+    {
+        if (double_hashing) {
+            BOB_pair(&key, sizeof(Key), BOB_seeds[0], BOB_seeds[1], h1, h2);
+        }
+    }
+
+    template<int i>
+    __attribute__((always_inline)) inline uint32_t probe() const
+    {
+        static_assert(i >= 0 && i < k, "probe index out of range");
+        if constexpr (double_hashing) {
+            return h1 + uint32_t(i) * h2 + uint32_t((i * i * i - i) / 6);
+        } else {
+            return BOB_n<sizeof(Key)>(i, &key);
+        }
+    }
+
+    // probe i for a k only known at run time, the same value as probe<i>()
+    __attribute__((always_inline)) inline uint32_t probe_at(int i) const
+    {
+        if constexpr (double_hashing) {
+            return h1 + uint32_t(i) * h2 + uint32_t((i * i * i - i) / 6);
+        } else {
+            return BOB_fixed<sizeof(Key)>(&key, BOB_seeds[i]);
+        }
+    }
+
+    // block of a blocked filter, taken from the high bits of h1 so that it does not bias the probes
+    inline uint64_t block(uint64_t block_num) const
+    {
+        if constexpr (double_hashing) {
+            return (uint64_t(h1) * block_num) >> 32;
+        } else {
+            return BOB_n<sizeof(Key)>(k, &key) % block_num;
+        }
+    }
+};
+
+template<typename F, int... I>
+inline bool for_probes_impl(F & f, integer_sequence<int, I...>)
+{
+    return (f(integral_constant<int, I>()) && ...);
+}
+
+// calls f(integral_constant<int, i>()) for i = 0 .. k - 1, unrolled, and stops at the first false
+template<int k, typename F>
+inline bool for_probes(F f)
+{
+    return for_probes_impl(f, make_integer_sequence<int, k>());
+}
+
+// k values that the runtime-sized filters dispatch to an unrolled path
+constexpr int max_fixed_k = 12;
+
+// calls f(integral_constant<int, k>()) if 1 <= k <= max_fixed_k and returns whether it did;
+// it has to be inlined into the caller, as a call of its own it costs as much as the query
+template<typename F>
+__attribute__((always_inline)) inline bool dispatch_k(int k, F f)
+{
+    switch (k) {
+    case 1: f(integral_constant<int, 1>()); return true;
+    case 2: f(integral_constant<int, 2>()); return true;
+    case 3: f(integral_constant<int, 3>()); return true;
+    case 4: f(integral_constant<int, 4>()); return true;
+    case 5: f(integral_constant<int, 5>()); return true;
+    case 6: f(integral_constant<int, 6>()); return true;
+    case 7: f(integral_constant<int, 7>()); return true;
+    case 8: f(integral_constant<int, 8>()); return true;
+    case 9: f(integral_constant<int, 9>()); return true;
+    case 10: f(integral_constant<int, 10>()); return true;
+    case 11: f(integral_constant<int, 11>()); return true;
+    case 12: f(integral_constant<int, 12>()); return true;
+    default: return false;
+    }
+}
+
+// x % d for a divisor only known at run time, without a division (Lemire et al., "Faster
+// remainder by direct computation"), exact for any 32-bit x and d
+class FastMod32
+{
+    uint64_t m;
+    uint32_t d;
+public:
+    explicit FastMod32(uint32_t _d = 1) : m(~0ull / _d + 1), d(_d) {}
+
+    __attribute__((always_inline)) inline uint32_t operator()(uint32_t x) const
+    {
+        return uint32_t((__uint128_t(m * x) * d) >> 64);
+    }
+};
+
+#endif //COLORINGCLASSIFER_BLOOM_HASH_H
@@ -0,0 +1,134 @@
+#ifndef COLORINGCLASSIFER_BLOOM_SIMD_H
+#define COLORINGCLASSIFER_BLOOM_SIMD_H
+
+// AVX2 helpers for the query_batch of the Bloom filters: 8 uint64 keys per group, one per 32-bit lane.
+// Everything here is bit-exact with the scalar path (BOB_fixed<8>, BOB_pair, ProbeHash, %).
+
+#ifdef __AVX2__
+
+#include <cstdint>
+#include <immintrin.h>
+#include "BOB_hash.h"
+
+#define simd_mix(a,b,c) \
+{ \
+  a = _mm256_sub_epi32(_mm256_sub_epi32(a, b), c); a = _mm256_xor_si256(a, _mm256_srli_epi32(c, 13)); \
+  b = _mm256_sub_epi32(_mm256_sub_epi32(b, c), a); b = _mm256_xor_si256(b, _mm256_slli_epi32(a, 8)); \
+  c = _mm256_sub_epi32(_mm256_sub_epi32(c, a), b); c = _mm256_xor_si256(c, _mm256_srli_epi32(b, 13)); \
+  a = _mm256_sub_epi32(_mm256_sub_epi32(a, b), c); a = _mm256_xor_si256(a, _mm256_srli_epi32(c, 12)); \
+  b = _mm256_sub_epi32(_mm256_sub_epi32(b, c), a); b = _mm256_xor_si256(b, _mm256_slli_epi32(a, 16)); \
+  c = _mm256_sub_epi32(_mm256_sub_epi32(c, a), b); c = _mm256_xor_si256(c, _mm256_srli_epi32(b, 5)); \
+  a = _mm256_sub_epi32(_mm256_sub_epi32(a, b), c); a = _mm256_xor_si256(a, _mm256_srli_epi32(c, 3)); \
+  b = _mm256_sub_epi32(_mm256_sub_epi32(b, c), a); b = _mm256_xor_si256(b, _mm256_slli_epi32(a, 10)); \
+  c = _mm256_sub_epi32(_mm256_sub_epi32(c, a), b); c = _mm256_xor_si256(c, _mm256_srli_epi32(b, 15)); \
+}
+
+// the low and high words of keys[0 .. 8), as the scalar hash sees them: it reads the bytes
+// as signed char, which subtracts 2^(8i+8) for every byte i >= 128
+inline void simd_load_keys(const uint64_t * keys, __m256i & lo, __m256i & hi)
+{
+    const __m256i perm = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i k0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)keys), perm);
+    __m256i k1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(keys + 4)), perm);
+    lo = _mm256_permute2x128_si256(k0, k1, 0x20);
+    hi = _mm256_permute2x128_si256(k0, k1, 0x31);
+
+    const __m256i sign_bits = _mm256_set1_epi32(0x00808080);
+    lo = _mm256_sub_epi32(lo, _mm256_slli_epi32(_mm256_and_si256(lo, sign_bits), 1));
+    hi = _mm256_sub_epi32(hi, _mm256_slli_epi32(_mm256_and_si256(hi, sign_bits), 1));
+}
+
+// BOB_fixed<8>(key, seed)
+inline __m256i simd_bob8(__m256i lo, __m256i hi, uint32_t seed)
+{
+    __m256i a = _mm256_add_epi32(_mm256_set1_epi32(0x9e3779b9), lo);
+    __m256i b = _mm256_add_epi32(_mm256_set1_epi32(0x9e3779b9), hi);
+    __m256i c = _mm256_set1_epi32(seed + 8);
+    simd_mix(a, b, c);
+    return c;
+}
+
+// BOB_pair(key, 8, seed1, seed2, h1, h2)
+inline void simd_bob8_pair(__m256i lo, __m256i hi, uint32_t seed1, uint32_t seed2, __m256i & h1, __m256i & h2)
+{
+    __m256i a = _mm256_add_epi32(_mm256_set1_epi32(0x9e3779b9), lo);
+    __m256i b = _mm256_add_epi32(_mm256_set1_epi32(0x9e3779b9 + seed2), hi);
+    __m256i c = _mm256_set1_epi32(seed1 + 8);
+    simd_mix(a, b, c);
+    h1 = c;
+    h2 = b;
+}
+
+// x % range for uint32 lanes and range < 2^31, through doubles:
+// the quotient from the reciprocal may be one off, the remainder is corrected for it
+inline __m256i simd_mod(__m256i x, uint32_t range)
+{
+    const __m256d r = _mm256_set1_pd(double(range));
+    const __m256d inv = _mm256_set1_pd(1.0 / double(range));
+    const __m256d zero = _mm256_setzero_pd();
+    const __m128i bias = _mm_set1_epi32(int32_t(0x80000000));
+
+    __m128i half[2] = {_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)};
+    for (int i = 0; i < 2; ++i) {
+        // uint32 -> double by flipping the sign bit and adding 2^31 back
+        __m256d d = _mm256_add_pd(_mm256_cvtepi32_pd(_mm_xor_si128(half[i], bias)), _mm256_set1_pd(2147483648.0));
+        __m256d q = _mm256_floor_pd(_mm256_mul_pd(d, inv));
+        __m256d m = _mm256_sub_pd(d, _mm256_mul_pd(q, r));
+        m = _mm256_add_pd(m, _mm256_and_pd(_mm256_cmp_pd(m, zero, _CMP_LT_OQ), r));
+        m = _mm256_sub_pd(m, _mm256_and_pd(_mm256_cmp_pd(m, r, _CMP_GE_OQ), r));
+        half[i] = _mm256_cvttpd_epi32(m);
+    }
+    return _mm256_set_m128i(half[1], half[0]);
+}
+
+// lanes that are still non-zero, as a gather mask
+inline __m256i simd_live(__m256i ret)
+{
+    return _mm256_xor_si256(_mm256_cmpeq_epi32(ret, _mm256_setzero_si256()), _mm256_set1_epi32(-1));
+}
+
+// the single class of a one-hot answer without a branch per key:
+// no bit -> none_val, several bits -> multi_val, otherwise the bit index (read from the float exponent)
+inline __m256i simd_decode(__m256i qr, int none_val, int multi_val)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i none = _mm256_cmpeq_epi32(qr, zero);
+    __m256i one_or_none = _mm256_cmpeq_epi32(_mm256_and_si256(qr, _mm256_sub_epi32(qr, _mm256_set1_epi32(1))), zero);
+
+    __m256i idx = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(qr)), 23);
+    idx = _mm256_sub_epi32(_mm256_and_si256(idx, _mm256_set1_epi32(0xff)), _mm256_set1_epi32(127));
+
+    __m256i res = _mm256_blendv_epi8(_mm256_set1_epi32(multi_val), idx, one_or_none);
+    return _mm256_blendv_epi8(res, _mm256_set1_epi32(none_val), none);
+}
+
+// ProbeHash for 8 keys
+template<int k, bool double_hashing>
+class ProbeHash8
+{
+    __m256i lo, hi;
+    __m256i h1, h2;
+public:
+    explicit ProbeHash8(const uint64_t * keys)
+    {
+        simd_load_keys(keys, lo, hi);
+        if (double_hashing) {
+            simd_bob8_pair(lo, hi, BOB_seeds[0], BOB_seeds[1], h1, h2);
+        }
+    }
+
+    template<int i>
+    inline __m256i probe() const
+    {
+        if constexpr (double_hashing) {
+            return _mm256_add_epi32(_mm256_add_epi32(h1, _mm256_mullo_epi32(h2, _mm256_set1_epi32(i))),
+                                    _mm256_set1_epi32((i * i * i - i) / 6));
+        } else {
+            return simd_bob8(lo, hi, BOB_seeds[i]);
+        }
+    }
+};
+
+#endif //__AVX2__
+
+#endif //COLORINGCLASSIFER_BLOOM_SIMD_H
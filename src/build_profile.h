@@ -0,0 +1,162 @@
+#ifndef COLORINGCLASSIFER_BUILD_PROFILE_H
+#define COLORINGCLASSIFER_BUILD_PROFILE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include "memory_usage.h"
+#include "perf_counters.h"
+
+using namespace std;
+
+// phases of ColoringClassifier::build(), in the order they run
+enum BuildPhase
+{
+    PHASE_HASHING,        // creating the edges (set_*_edge, ShiftingColoringClassifier::build) and rehashing
+    PHASE_NEG_UNION,      // union of the buckets linked by neg edges
+    PHASE_POS_CHECK,      // pos edges inside one group, i.e. edge collisions
+    PHASE_GROUP_COLLECT,  // groups and their neighbours in try_color_all
+    PHASE_PEELING,        // removing groups with < COLOR_NUM neighbours in try_color_groups
+    PHASE_COLORING,       // coloring in reverse peeling order
+    PHASE_SYNC,           // synchronize_all, packing the colors into buckets
+    PHASE_NUM
+};
+
+static const char * const build_phase_names[PHASE_NUM] = {
+    "hashing", "neg_union", "pos_check", "group_collect", "peeling", "coloring", "sync"
+};
+
+struct PhaseStats
+{
+    uint64_t calls;
+    double wall_ms;
+    // net change of the resident memory, i.e. what the phase allocated and touched;
+    // negative when it gave memory back to the OS. Not a count of allocations: memory freed
+    // and reused by malloc inside the phase does not show.
+    int64_t rss_delta_bytes;
+    // highest RSS of the process while the phase ran, the largest over its calls. It is the
+    // whole process: other threads (and concurrent builds) add to it.
+    long peak_rss_kb;
+    // cycles, misses, ... of the building thread, see perf_counters.h
+    PerfSample perf;
+};
+
+// Per-phase wall time, resident memory delta and peak memory of a build, replacing the gprof build.
+// Phases add up over the life of the classifier (hashing happens in set_*_edge, before build()),
+// clear() starts over. Each phase costs two clock reads, two reads of /proc/self/statm, a reset of
+// the peak (restart_peak_rss) and a read of VmHWM plus one read per perf counter, some ten
+// microseconds against a build of milliseconds or more, so it stays on in release builds. (mallinfo2 would count malloc bytes exactly, but it walks all free chunks and
+// takes 100s of ms once a build has freed its millions of group nodes.)
+struct BuildProfile
+{
+    PhaseStats phases[PHASE_NUM];
+    // rounds of build() until there was no edge collision (or MAX_EDGE_COLLISION_TIME)
+    int attempts;
+    bool ok;
+
+    BuildProfile()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (auto & p: phases) {
+            p = PhaseStats();
+        }
+        attempts = 0;
+        ok = false;
+    }
+
+    double total_ms() const
+    {
+        double t = 0;
+        for (auto & p: phases) {
+            t += p.wall_ms;
+        }
+        return t;
+    }
+
+    void dump(FILE * f = stdout) const
+    {
+        fprintf(f, "build profile: %s after %d attempt(s), %.2f ms\n", ok ? "ok" : "failed", attempts, total_ms());
+        for (int i = 0; i < PHASE_NUM; ++i) {
+            fprintf(f, "  %-14s calls=%-4lu %10.2f ms  rss %+10.2f MB  peak rss %8.1f MB\n", build_phase_names[i],
+                    (unsigned long)phases[i].calls, phases[i].wall_ms, phases[i].rss_delta_bytes / 1048576.0,
+                    phases[i].peak_rss_kb / 1024.0);
+            if (phases[i].perf.valid) {
+                fprintf(f, "  %-14s", "");
+                phases[i].perf.dump(f);
+                fprintf(f, "\n");
+            }
+        }
+    }
+
+    void write_json(FILE * f) const
+    {
+        fprintf(f, "{\"ok\": %s, \"attempts\": %d, \"total_ms\": %.3f, \"perf_source\": \"%s\", \"phases\": {",
+                ok ? "true" : "false", attempts, total_ms(), PerfCounters::thread_counters().source());
+        for (int i = 0; i < PHASE_NUM; ++i) {
+            fprintf(f, "%s\"%s\": {\"calls\": %lu, \"wall_ms\": %.3f, \"rss_delta_bytes\": %lld, \"peak_rss_kb\": %ld, "
+                    "\"perf\": ", i ? ", " : "", build_phase_names[i], (unsigned long)phases[i].calls,
+                    phases[i].wall_ms, (long long)phases[i].rss_delta_bytes, phases[i].peak_rss_kb);
+            phases[i].perf.write_json(f);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}}\n");
+    }
+};
+
+// resident bytes of the process, 0 where /proc is missing
+inline int64_t profile_rss_bytes()
+{
+    static int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    static const long page_size = sysconf(_SC_PAGESIZE);
+    char buf[128];
+    ssize_t n = fd >= 0 ? pread(fd, buf, sizeof(buf) - 1, 0) : -1;
+    if (n <= 0) {
+        return 0;
+    }
+    buf[n] = 0;
+    // size resident shared ..., in pages
+    char * p = buf;
+    strtol(p, &p, 10);
+    return int64_t(strtol(p, NULL, 10)) * page_size;
+}
+
+// adds the scope it lives in to one phase of a BuildProfile
+class PhaseTimer
+{
+    PhaseStats & stats;
+    // first, so the reset is not counted in the phase
+    bool peak_restarted;
+    chrono::steady_clock::time_point t0;
+    int64_t rss0;
+    PerfSample perf0;
+public:
+    PhaseTimer(BuildProfile & profile, BuildPhase phase)
+            : stats(profile.phases[phase]), peak_restarted(restart_peak_rss()), t0(chrono::steady_clock::now()),
+              rss0(profile_rss_bytes()), perf0(PerfCounters::thread_counters().read())
+    {
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer & operator=(const PhaseTimer &) = delete;
+
+    ~PhaseTimer()
+    {
+        stats.perf += PerfCounters::thread_counters().read() - perf0;
+        stats.calls++;
+        stats.rss_delta_bytes += profile_rss_bytes() - rss0;
+        // the peak of this phase only, peak_rss_bytes() still sees what came before
+        long peak_kb = long(peak_since_restart_rss_bytes() / 1024);
+        stats.peak_rss_kb = peak_kb > stats.peak_rss_kb ? peak_kb : stats.peak_rss_kb;
+        stats.wall_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    }
+};
+
+#endif //COLORINGCLASSIFER_BUILD_PROFILE_H
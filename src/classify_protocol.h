@@ -0,0 +1,198 @@
+#ifndef COLORINGCLASSIFER_CLASSIFY_PROTOCOL_H
+#define COLORINGCLASSIFER_CLASSIFY_PROTOCOL_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+
+// Wire format of the classification server, native byte order (the peers are on one machine):
+//   request   ClassifyHeader{CLASSIFY_REQUEST, count}   uint64 key[count]
+//   response  ClassifyHeader{CLASSIFY_RESPONSE, count}  int32 class[count], in the order of the keys
+// A connection carries any number of requests, answered in order; a client may pipeline them.
+// A request with a bad magic or more than CLASSIFY_MAX_BATCH keys closes the connection.
+
+#define CLASSIFY_REQUEST 0x51524343u    // "CCRQ"
+#define CLASSIFY_RESPONSE 0x53524343u   // "CCRS"
+#define CLASSIFY_MAX_BATCH (1u << 16)
+
+struct ClassifyHeader
+{
+    uint32_t magic;
+    uint32_t count;
+};
+
+inline size_t classify_request_bytes(uint32_t count)
+{
+    return sizeof(ClassifyHeader) + size_t(count) * sizeof(uint64_t);
+}
+
+inline size_t classify_response_bytes(uint32_t count)
+{
+    return sizeof(ClassifyHeader) + size_t(count) * sizeof(int32_t);
+}
+
+// where the server listens: a Unix domain socket path, or a TCP host and port
+struct Endpoint
+{
+    bool unix_socket;
+    string path;
+    string host;
+    int port;
+
+    Endpoint() : unix_socket(true), path("/tmp/cc_classify.sock"), host("127.0.0.1"), port(0) {}
+
+    // "unix:PATH", "tcp:[HOST:]PORT", or a bare PATH / PORT
+    bool parse(const string & spec)
+    {
+        string s = spec;
+        bool tcp = false;
+        if (s.compare(0, 5, "unix:") == 0) {
+            s = s.substr(5);
+        } else if (s.compare(0, 4, "tcp:") == 0) {
+            s = s.substr(4);
+            tcp = true;
+        } else {
+            tcp = !s.empty() && s.find_first_not_of("0123456789") == string::npos;
+        }
+        if (!tcp) {
+            unix_socket = true;
+            path = s;
+            return !path.empty() && path.size() < sizeof(((sockaddr_un *)0)->sun_path);
+        }
+        unix_socket = false;
+        size_t colon = s.rfind(':');
+        if (colon != string::npos) {
+            host = s.substr(0, colon);
+            s = s.substr(colon + 1);
+        }
+        port = atoi(s.c_str());
+        return port > 0 && port < 65536;
+    }
+
+    string str() const
+    {
+        return unix_socket ? "unix:" + path : "tcp:" + host + ":" + to_string(port);
+    }
+};
+
+// an unconnected socket and the address of ep, resolving the TCP host; -1 on failure
+inline int endpoint_socket(const Endpoint & ep, sockaddr_storage & addr, socklen_t & addr_len)
+{
+    memset(&addr, 0, sizeof(addr));
+    if (ep.unix_socket) {
+        sockaddr_un * un = (sockaddr_un *)&addr;
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, ep.path.c_str(), sizeof(un->sun_path) - 1);
+        addr_len = sizeof(sockaddr_un);
+        return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    addrinfo hints, * res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(ep.host.c_str(), to_string(ep.port).c_str(), &hints, &res) != 0 || !res) {
+        fprintf(stderr, "Cannot resolve %s\n", ep.host.c_str());
+        return -1;
+    }
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addr_len = res->ai_addrlen;
+    int family = res->ai_family;
+    freeaddrinfo(res);
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// a listening socket, non-blocking; a stale Unix socket file is replaced
+inline int listen_endpoint(const Endpoint & ep)
+{
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    int fd = endpoint_socket(ep, addr, addr_len);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create a socket for %s\n", ep.str().c_str());
+        return -1;
+    }
+    if (ep.unix_socket) {
+        unlink(ep.path.c_str());
+    } else {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(fd, (sockaddr *)&addr, addr_len) != 0 || listen(fd, 1024) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", ep.str().c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// a blocking connection, -1 with a message on failure
+inline int connect_endpoint(const Endpoint & ep)
+{
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    int fd = endpoint_socket(ep, addr, addr_len);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (sockaddr *)&addr, addr_len) != 0) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", ep.str().c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// blocking send / receive of exactly len bytes, false on error or end of stream
+inline bool send_all(int fd, const void * buf, size_t len)
+{
+    const char * p = (const char *)buf;
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+inline bool recv_all(int fd, void * buf, size_t len)
+{
+    char * p = (char *)buf;
+    while (len) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+#endif //COLORINGCLASSIFER_CLASSIFY_PROTOCOL_H
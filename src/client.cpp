@@ -0,0 +1,325 @@
+// Load generator for the classification server, built as the `client` target (-O3).
+//
+//   client [csv|json] [-l endpoint] [-c connections] [-b batch] [-p pipeline] [-n requests]
+//          [-g keys[:classes] | dataset]
+//
+// Each connection is a thread of its own running a closed loop: it keeps `pipeline` requests of
+// `batch` keys in flight (default 1, one request at a time) and sends the next as soon as an answer
+// comes back, until it has had `requests` answers (default 10000). Sends and receives interleave
+// on a non-blocking socket, so any pipeline of any batch size makes progress. Latency is from the send of a
+// request to the end of its answer, so with a pipeline it includes the wait behind the requests
+// in front of it.
+// Keys come from the same sources as the server takes, and the answers are checked:
+//   -g keys[:classes]  members of workload.h with the default seed, one query stream per
+//                      connection; an answer must be class i % classes (what `server -g` built)
+//   dataset            the keys of the dump in file order, wrapping around; an answer must be
+//                      the first class of the key in the file, what `server dataset` keeps
+// Without either, uniform random keys are sent and nothing is checked (e.g. against an image).
+// Reported: requests and keys per second over all connections, latency p50 / p99 / p99.9 / max
+// in microseconds, and the wrong answers.
+
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include "classify_protocol.h"
+#include "dataset.h"
+#include "workload.h"
+
+using namespace std;
+
+struct ConnectionResult
+{
+    bool ok;
+    uint64_t requests;
+    uint64_t keys;
+    uint64_t wrong;
+    vector<float> latency_us;
+};
+
+// keys with their expected classes (-1: not checked), requests take consecutive slices, wrapping
+struct KeySource
+{
+    vector<uint64_t> keys;
+    vector<int> expected;
+};
+
+// one closed-loop connection on a non-blocking socket: answers are read whenever they arrive,
+// also while a request is only partly sent, so a server that stops reading until its answers
+// are taken can not deadlock with us. The keys of a request go straight from the source with writev.
+void run_connection(const Endpoint & ep, const KeySource & src, uint32_t batch, int pipeline, uint64_t request_num,
+                    ConnectionResult & res)
+{
+    res.ok = false;
+    res.requests = res.keys = res.wrong = 0;
+    res.latency_us.reserve(request_num);
+    int fd = connect_endpoint(ep);
+    if (fd < 0) {
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    size_t key_num = src.keys.size();
+    size_t send_pos = 0, recv_pos = 0;
+    vector<chrono::steady_clock::time_point> sent(pipeline);
+    ClassifyHeader req = {CLASSIFY_REQUEST, batch};
+    const size_t req_bytes = classify_request_bytes(batch), resp_bytes = classify_response_bytes(batch);
+    // requests started, bytes of the last one that went out, bytes of the next answer received
+    uint64_t sent_num = 0;
+    size_t req_done = req_bytes, resp_len = 0;
+    vector<char> resp(resp_bytes);
+
+    // sends until the socket is full or the pipeline is; false on error
+    auto send_requests = [&]() {
+        while (true) {
+            if (req_done == req_bytes) {
+                if (sent_num == request_num || sent_num - res.requests == uint64_t(pipeline)) {
+                    return true;
+                }
+                sent[sent_num % pipeline] = chrono::steady_clock::now();
+                sent_num++;
+                req_done = 0;
+            }
+            // a batch may wrap around the end of the keys, then it is sent from two slices
+            size_t first = min<size_t>(batch, key_num - send_pos);
+            iovec iov[3] = {{&req, sizeof(req)},
+                            {(void *)(src.keys.data() + send_pos), first * sizeof(uint64_t)},
+                            {(void *)src.keys.data(), (batch - first) * sizeof(uint64_t)}};
+            int iov_first = 0;
+            for (size_t skip = req_done; skip; ) {
+                size_t n = min(skip, iov[iov_first].iov_len);
+                iov[iov_first].iov_base = (char *)iov[iov_first].iov_base + n;
+                iov[iov_first].iov_len -= n;
+                skip -= n;
+                if (iov[iov_first].iov_len == 0) {
+                    iov_first++;
+                }
+            }
+            ssize_t n = writev(fd, iov + iov_first, 3 - iov_first);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            req_done += size_t(n);
+            if (req_done == req_bytes) {
+                send_pos = (send_pos + batch) % key_num;
+            } else {
+                return true;
+            }
+        }
+    };
+
+    // takes every answer the socket has; false on error or a bad answer
+    auto recv_answers = [&]() {
+        while (res.requests < sent_num) {
+            ssize_t n = recv(fd, resp.data() + resp_len, resp_bytes - resp_len, 0);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            if (n == 0) {
+                fprintf(stderr, "Connection closed by the server\n");
+                return false;
+            }
+            resp_len += size_t(n);
+            if (resp_len < resp_bytes) {
+                continue;
+            }
+            const ClassifyHeader * h = (const ClassifyHeader *)resp.data();
+            if (h->magic != CLASSIFY_RESPONSE || h->count != batch) {
+                fprintf(stderr, "Bad response\n");
+                return false;
+            }
+            auto now = chrono::steady_clock::now();
+            res.latency_us.push_back(float(chrono::duration<double, micro>(now - sent[res.requests % pipeline]).count()));
+            const int32_t * answers = (const int32_t *)(resp.data() + sizeof(ClassifyHeader));
+            for (uint32_t i = 0; i < batch; ++i) {
+                size_t k = (recv_pos + i) % key_num;
+                res.wrong += src.expected[k] >= 0 && answers[i] != src.expected[k];
+            }
+            recv_pos = (recv_pos + batch) % key_num;
+            res.requests++;
+            res.keys += batch;
+            resp_len = 0;
+        }
+        return true;
+    };
+
+    bool ok = send_requests();
+    while (ok && res.requests < request_num) {
+        bool want_send = req_done < req_bytes || (sent_num < request_num && sent_num - res.requests < uint64_t(pipeline));
+        pollfd pfd = {fd, short(POLLIN | (want_send ? POLLOUT : 0)), 0};
+        int ready = poll(&pfd, 1, 30000);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            fprintf(stderr, "No progress for 30 s, %lu of %lu answers\n", (unsigned long)res.requests,
+                    (unsigned long)request_num);
+            ok = false;
+            break;
+        }
+        ok = recv_answers() && send_requests();
+    }
+    close(fd);
+    res.ok = ok;
+}
+
+double percentile(const vector<float> & sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = min(sorted.size() - 1, size_t(p * sorted.size()));
+    return sorted[i];
+}
+
+int main(int argc, char ** argv)
+{
+    bool json = false;
+    Endpoint ep;
+    int connection_num = 1, pipeline = 1;
+    uint32_t batch = 256;
+    uint64_t request_num = 10000;
+    uint64_t gen_num = 0;
+    uint32_t gen_class_num = 2;
+    string dataset;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "csv") == 0) {
+            json = false;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            if (!ep.parse(argv[++i])) {
+                fprintf(stderr, "Bad endpoint %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            connection_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batch = uint32_t(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            pipeline = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            request_num = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            const char * spec = argv[++i];
+            gen_num = strtoull(spec, NULL, 10);
+            const char * colon = strchr(spec, ':');
+            if (colon) {
+                gen_class_num = uint32_t(atoi(colon + 1));
+            }
+        } else {
+            dataset = argv[i];
+        }
+    }
+    if (connection_num < 1 || pipeline < 1 || batch < 1 || batch > CLASSIFY_MAX_BATCH || request_num < 1 ||
+        gen_class_num < 1) {
+        fprintf(stderr, "usage: %s [csv|json] [-l unix:PATH | tcp:[HOST:]PORT] [-c connections] [-b batch] "
+                "[-p pipeline] [-n requests] [-g keys[:classes] | dataset]\n", argv[0]);
+        return 1;
+    }
+
+    // the keys one connection goes through, a multiple of the batch is not needed
+    size_t stream_len = size_t(min<uint64_t>(request_num * batch, 1 << 22));
+    vector<KeySource> sources(connection_num);
+    if (!dataset.empty()) {
+        Dataset ds;
+        if (!ds.open(dataset)) {
+            return 1;
+        }
+        if (ds.size() == 0) {
+            fprintf(stderr, "%s has no keys\n", dataset.c_str());
+            return 1;
+        }
+        // the server builds on the first class of a repeated key
+        unordered_map<uint64_t, uint32_t> first_class;
+        first_class.reserve(ds.size());
+        for (size_t i = 0; i < ds.size(); ++i) {
+            first_class.emplace(ds.key(i), ds.class_of(i));
+        }
+        // every connection starts at another place in the file
+        for (int c = 0; c < connection_num; ++c) {
+            KeySource & src = sources[c];
+            size_t len = min(stream_len, ds.size());
+            for (size_t i = 0; i < len; ++i) {
+                size_t j = (ds.size() / connection_num * c + i) % ds.size();
+                src.keys.push_back(ds.key(j));
+                src.expected.push_back(int(first_class[ds.key(j)]));
+            }
+        }
+    } else if (gen_num) {
+        WorkloadSpec spec;
+        spec.class_num = gen_class_num;
+        WorkloadGenerator gen(spec);
+        for (int c = 0; c < connection_num; ++c) {
+            sources[c].keys = gen.queries(stream_len, gen_num, QueryMix(), uint64_t(c), &sources[c].expected);
+        }
+    } else {
+        for (int c = 0; c < connection_num; ++c) {
+            mt19937_64 rng(c + 1);
+            sources[c].keys.resize(stream_len);
+            sources[c].expected.assign(stream_len, -1);
+            for (auto & key: sources[c].keys) {
+                key = rng();
+            }
+        }
+    }
+
+    if (sources[0].keys.size() < batch) {
+        fprintf(stderr, "A batch of %u is more than the %lu keys\n", batch, (unsigned long)sources[0].keys.size());
+        return 1;
+    }
+    // writev has no MSG_NOSIGNAL, a server going away must not kill the client
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<ConnectionResult> results(connection_num);
+    vector<thread> threads;
+    auto t0 = chrono::steady_clock::now();
+    for (int c = 0; c < connection_num; ++c) {
+        threads.push_back(thread([&, c] {
+            run_connection(ep, sources[c], batch, pipeline, request_num, results[c]);
+        }));
+    }
+    for (auto & th: threads) {
+        th.join();
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    bool ok = true;
+    uint64_t requests = 0, keys = 0, wrong = 0;
+    vector<float> latency;
+    for (auto & r: results) {
+        ok = ok && r.ok;
+        requests += r.requests;
+        keys += r.keys;
+        wrong += r.wrong;
+        latency.insert(latency.end(), r.latency_us.begin(), r.latency_us.end());
+    }
+    sort(latency.begin(), latency.end());
+    double p50 = percentile(latency, 0.5), p99 = percentile(latency, 0.99), p999 = percentile(latency, 0.999);
+    double max_us = latency.empty() ? 0 : latency.back();
+
+    if (json) {
+        printf("{\"endpoint\": \"%s\", \"connections\": %d, \"batch\": %u, \"pipeline\": %d, \"requests\": %lu, "
+               "\"keys\": %lu, \"seconds\": %.3f, \"requests_per_s\": %.1f, \"mkeys_per_s\": %.3f, "
+               "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f, \"wrong\": %lu, "
+               "\"ok\": %s}\n", ep.str().c_str(), connection_num, batch, pipeline, (unsigned long)requests,
+               (unsigned long)keys, secs, requests / secs, keys / secs / 1e6, p50, p99, p999, max_us,
+               (unsigned long)wrong, ok ? "true" : "false");
+    } else {
+        printf("endpoint,connections,batch,pipeline,requests,keys,seconds,requests_per_s,mkeys_per_s,"
+               "p50_us,p99_us,p999_us,max_us,wrong,ok\n");
+        printf("%s,%d,%u,%d,%lu,%lu,%.3f,%.1f,%.3f,%.1f,%.1f,%.1f,%.1f,%lu,%d\n", ep.str().c_str(), connection_num,
+               batch, pipeline, (unsigned long)requests, (unsigned long)keys, secs, requests / secs,
+               keys / secs / 1e6, p50, p99, p999, max_us, (unsigned long)wrong, int(ok));
+    }
+    return ok && wrong == 0 ? 0 : 1;
+}
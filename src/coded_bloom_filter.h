@@ -6,36 +6,54 @@
 #include "utils.h"
 
 
-template<int num_bits, int k, int class_num = 2>
-class CodedBloomFilter: public MultiWayBloomFilter<num_bits, k, log2(class_num)>
+template<int num_bits, int k, int class_num = 2, typename Key = uint64_t, bool blocked = false,
+         bool double_hashing = false>
+class CodedBloomFilter: public MultiWayBloomFilter<num_bits, k, log2(class_num), Key, blocked, double_hashing>
 {
     constexpr static int num_bf = log2(class_num);
 public:
     const string name;
     constexpr static int _class_num = class_num;
 
-    CodedBloomFilter() : name("CodedBF")
+    CodedBloomFilter() : name(blocked ? "BlockedCodedBF" : "CodedBF")
     {
     }
 
-    void insert(uint64_t key, int class_id)
+    void insert(const Key & key, int class_id)
     {
         int idx = 0;
         while (class_id) {
             if (class_id & 1) {
-                MultiWayBloomFilter<num_bits, k, log2(class_num)>::insert_bf(key, idx);
+                MultiWayBloomFilter<num_bits, k, log2(class_num), Key, blocked, double_hashing>::insert_bf(key, idx);
             }
             idx += 1;
             class_id /= 2;
         }
     }
 
-    int query(uint64_t key)
+    int query(const Key & key) const
     {
-        return MultiWayBloomFilter<num_bits, k, log2(class_num)>::query_multiway(key);
+        return MultiWayBloomFilter<num_bits, k, log2(class_num), Key, blocked, double_hashing>::query_multiway(key);
     }
 
-    bool build(KVList & kvs, int num)
+    // query() of keys[0 .. num) into results
+    void query_batch(const Key * keys, int * results, size_t num) const
+    {
+        size_t i = 0;
+#ifdef __AVX2__
+        if constexpr (MultiWayBloomFilter<num_bits, k, log2(class_num), Key, blocked, double_hashing>::simd_batch) {
+            for (; i + 8 <= num; i += 8) {
+                _mm256_storeu_si256((__m256i *)(results + i),
+                        MultiWayBloomFilter<num_bits, k, log2(class_num), Key, blocked, double_hashing>::query_multiway_x8(keys + i));
+            }
+        }
+#endif
+        for (; i < num; ++i) {
+            results[i] = query(keys[i]);
+        }
+    }
+
+    bool build(KeyValueList<Key> & kvs, int num)
     {
         for (int i = 0; i < num; ++i) {
             insert(kvs[i].first, kvs[i].second);
@@ -44,7 +62,7 @@ public:
         return true;
     }
 
-    bool exp_build(uint64_t * keys, int num)
+    bool exp_build(Key * keys, int num)
     {
         for (int i = 0; i < num / 2; ++i) {
             insert(keys[i], 0);
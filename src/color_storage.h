@@ -0,0 +1,100 @@
+#ifndef COLORINGCLASSIFER_COLOR_STORAGE_H
+#define COLORINGCLASSIFER_COLOR_STORAGE_H
+
+#include <cstdint>
+#include <cstring>
+
+// Packed storage of one color per bucket, chosen at compile time from the color num:
+//   3 and 5 colors: radix packing, 5 (3^5 = 243) or 3 (5^3 = 125) buckets per byte, decoded by a 256-entry table
+//   otherwise:      ceil(log2(color num)) bits per bucket, read with one unaligned 16-bit load
+
+constexpr int color_bits(int color_num)
+{
+    return color_num <= 2 ? 1 : 1 + color_bits((color_num + 1) / 2);
+}
+
+template<int color_num>
+struct RadixColorStorage
+{
+    static constexpr int per_byte = (color_num == 3) ? 5 : 3;
+
+    struct Table
+    {
+        uint8_t digit[256][per_byte];
+        uint8_t weight[per_byte];
+
+        constexpr Table() : digit(), weight()
+        {
+            int w = 1;
+            for (int pos = 0; pos < per_byte; ++pos) {
+                weight[pos] = uint8_t(w);
+                for (int b = 0; b < 256; ++b) {
+                    digit[b][pos] = uint8_t((b / w) % color_num);
+                }
+                w *= color_num;
+            }
+        }
+    };
+    static constexpr Table table = Table();
+
+    static constexpr uint64_t bytes(uint64_t bucket_num)
+    {
+        return (bucket_num + per_byte - 1) / per_byte;
+    }
+
+    static inline int get(const uint8_t * data, uint64_t idx)
+    {
+        return table.digit[data[idx / per_byte]][idx % per_byte];
+    }
+
+    static inline void set(uint8_t * data, uint64_t idx, int color)
+    {
+        uint8_t & b = data[idx / per_byte];
+        int pos = int(idx % per_byte);
+        b = uint8_t(b + (int(unsigned(color) % color_num) - table.digit[b][pos]) * table.weight[pos]);
+    }
+};
+
+template<int color_num>
+struct BitColorStorage
+{
+    static constexpr int bits = color_bits(color_num);
+    static constexpr uint16_t mask = (1u << bits) - 1;
+
+    // one spare byte so the 16-bit load of the last bucket stays in bounds
+    static constexpr uint64_t bytes(uint64_t bucket_num)
+    {
+        return (bucket_num * bits + 7) / 8 + 1;
+    }
+
+    static inline int get(const uint8_t * data, uint64_t idx)
+    {
+        uint64_t bit = idx * bits;
+        uint16_t w;
+        memcpy(&w, data + bit / 8, sizeof(w));
+        return (w >> (bit % 8)) & mask;
+    }
+
+    static inline void set(uint8_t * data, uint64_t idx, int color)
+    {
+        uint64_t bit = idx * bits;
+        uint16_t w;
+        memcpy(&w, data + bit / 8, sizeof(w));
+        w = uint16_t((w & ~(mask << (bit % 8))) | ((uint16_t(color) & mask) << (bit % 8)));
+        memcpy(data + bit / 8, &w, sizeof(w));
+    }
+};
+
+template<int color_num>
+struct ColorStorage : public BitColorStorage<color_num>
+{
+    static_assert(color_num >= 2 && color_num <= 256, "color num must be in [2, 256]");
+};
+
+template<>
+struct ColorStorage<3> : public RadixColorStorage<3> {};
+
+template<>
+struct ColorStorage<5> : public RadixColorStorage<5> {};
+
+#endif //COLORINGCLASSIFER_COLOR_STORAGE_H
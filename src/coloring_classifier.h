@@ -8,84 +8,126 @@
 #include <cstdint>
 #include <vector>
 #include <cstring>
+#include <string_view>
 #include <unordered_map>
 #include "BOB_hash.h"
+#include "snapshot.h"
+#include "query_image.h"
+#include "color_storage.h"
+#include "key_types.h"
+#include "utils.h"
+#include "huge_page_alloc.h"
+#include "insert_stats.h"
+#include "build_profile.h"
+#include "memory_usage.h"
+#include <type_traits>
+#include <algorithm>
 #include <unordered_set>
 #include <list>
 #include <queue>
-#include <ctime>
+#include <random>
 
 #define MAX_EDGE_COLLISION_TIME 1
 
 using namespace std;
 
-BOBHash * hash1, * hash2;
+// map a key to its two buckets, shared by the classifier and the query image reader,
+// all sizeof(Key) bytes are hashed so keys differing only in their high bytes still spread out
+template<typename Key>
+inline void cc_hash_pair(const Key & e, const BOBHash & h1, const BOBHash & h2, uint32_t hash_range,
+                         uint32_t & hash_val_a, uint32_t & hash_val_b)
+{
+    static_assert(is_trivially_copyable<Key>::value, "keys must be trivially copyable");
+    uint32_t x = h1.run<sizeof(Key)>(&e);
+    uint32_t y = h2.run<sizeof(Key)>(&e);
+    hash_val_a = x % hash_range;
+    hash_val_b = y % hash_range;
+    uint32_t i = 1;
+    while (hash_val_a == hash_val_b) {
+        hash_val_b = (x + (i++) * y) % hash_range;
+    }
+}
+
+// string keys of any length are hashed once, both buckets come from the same pass,
+// and the two hashes together form the 64-bit fingerprint used as the overflow table key
+inline uint64_t cc_hash_pair(string_view str, const BOBHash & h1, const BOBHash & h2, uint32_t hash_range,
+                             uint32_t & hash_val_a, uint32_t & hash_val_b)
+{
+    uint32_t x, y;
+    BOB_pair(str.data(), str.size(), h1.seed, h2.seed, x, y);
+    hash_val_a = x % hash_range;
+    hash_val_b = y % hash_range;
+    uint32_t i = 1;
+    while (hash_val_a == hash_val_b) {
+        hash_val_b = (x + (i++) * y) % hash_range;
+    }
+    return (uint64_t(y) << 32) | x;
+}
 
-template<int32_t bucket_num, int32_t COLOR_NUM = 4, bool verbose = 0>
+template<int32_t bucket_num, int32_t COLOR_NUM = 4, bool verbose = 0, typename Key = uint64_t>
 class ColoringClassifier
 {
     // buckets是unit8，如果是4个颜色的话，2 bit就行了
-    // Transferring v_bucket and bucket in the 2 function sync, and we actually don't use bucket in the algorithm
-    uint8_t buckets[bucket_num];
+    // Transferring v_bucket and bucket in the 2 function sync, queries read the packed colors from bucket
+    typedef ColorStorage<COLOR_NUM> Storage;
+    uint8_t buckets[Storage::bytes(bucket_num)];
+public:
+    // buckets, v_buckets and old_buckets live in the object, so a big classifier is one huge-page block
+    HUGE_PAGE_NEW
 private:
     template<uint32_t hash_range>
     struct Edge
     {
         // 被hash的可以是str，也可以是int64
-        uint64_t e;
+        // for str keys e is the fingerprint, and e_str points to the caller's key without copying it
+        Key e;
         uint32_t hash_val_a;
         uint32_t hash_val_b;
         bool available;
-        char e_str[MAX_LEN];
+        string_view e_str;
 
         // 设置Hash的值，val_a and val_b，即两个bucket
-        void set_hash_val(uint64_t _e) {
+        // the hash functions belong to the classifier that owns this edge
+        void set_hash_val(const Key & _e, const BOBHash & h1, const BOBHash & h2) {
             e = _e;
-            // 这边的4是指size，可是为什么是4呢？可能需要研究一下BOB_Hash
-            hash_val_a = hash1->run(&e, 4) % hash_range;
-            hash_val_b = hash2->run(&e, 4) % hash_range;
-            int i = 1;
-            while (hash_val_a == hash_val_b) {
-                hash_val_b = (hash1->run(&e, 4) +
-                    (i++) * hash2->run(&e, 4)) % hash_range;
-            }
+            cc_hash_pair(e, h1, h2, hash_range, hash_val_a, hash_val_b);
+        }
+
+        void set_hash_val(string_view str, const BOBHash & h1, const BOBHash & h2) {
+            static_assert(is_same<Key, uint64_t>::value, "str keys are stored by their 64-bit fingerprint");
+            e_str = str;
+            e = cc_hash_pair(str, h1, h2, hash_range, hash_val_a, hash_val_b);
         }
 
-        void set_hash_val(const char * str) {
-            strcpy(e_str, str);
-            hash_val_a = hash1->run(e_str, strlen(e_str)) % hash_range;
-            hash_val_b = hash2->run(e_str, strlen(e_str)) % hash_range;
-            int i = 1;
-            while (hash_val_a == hash_val_b) {
-                hash_val_b = (hash1->run(&e, 4) +
-                    (i++) * hash2->run(&e, 4)) % hash_range;
+        // hash again with new hash functions, from the string if this is a str key
+        void rehash(const BOBHash & h1, const BOBHash & h2) {
+            if constexpr (is_same<Key, uint64_t>::value) {
+                if (e_str.data()) {
+                    set_hash_val(e_str, h1, h2);
+                    return;
+                }
             }
+            set_hash_val(e, h1, h2);
         }
 
         // 5个构造函数，前3个直接构造，后面2个复制构造
         Edge() : available(true) {}
-        Edge(uint64_t _e) : available(true) {
-            set_hash_val(_e);
+        Edge(const Key & _e, const BOBHash & h1, const BOBHash & h2) : available(true) {
+            set_hash_val(_e, h1, h2);
         }
 
-        Edge(const char * e_str) : available(true) {
-            set_hash_val(e_str);
+        Edge(string_view e_str, const BOBHash & h1, const BOBHash & h2) : available(true) {
+            set_hash_val(e_str, h1, h2);
         }
 
         Edge(const Edge & edge, int offset) {
             available = edge.available;
             e = edge.e;
-            strcpy(e_str, edge.e_str);
+            e_str = edge.e_str;
             hash_val_a = (edge.hash_val_a + offset) % hash_range;
             hash_val_b = (edge.hash_val_b + offset) % hash_range;
         }
-        Edge(const Edge& edge) {
-            available = edge.available;
-            e = edge.e;
-            strcpy(e_str, edge.e_str);
-            hash_val_a = edge.hash_val_a;
-            hash_val_b = edge.hash_val_b;
-        }
+        Edge(const Edge& edge) = default;
 
         // query the other node of this edge
         uint32_t get_other_val(uint32_t i) const {
@@ -104,30 +146,40 @@ public:
     int edge_collision_num;
     int affected_node_num;
     int node_num_to_update;
+    // outcomes and latencies of insert(), see insert_stats.h
+    InsertStats insert_stats;
+    // time, allocations and peak memory of each build phase, see build_profile.h
+    BuildProfile build_profile;
     int BUCKET_NUM = bucket_num;
     int collision_time;
     string name;
 
 protected:
+    // hash functions and the rng used to reseed them are owned by each instance,
+    // so several classifiers can be built and queried in parallel
+    BOBHash hash1, hash2;
+    mt19937 rng;
+
     typedef Edge<bucket_num> CCEdge;
     // 正边和负边分开记录，构造时会用到
     vector<CCEdge *> pos_edges, neg_edges;
 public:
     struct overflowtable{
-        unordered_map<uint64_t, uint32_t> ErrorTable;
+        unordered_map<Key, uint32_t, hash<Key>, equal_to<Key>, HugePageAllocator<pair<const Key, uint32_t>>> ErrorTable;
 
-        int size(){
+        int size() const {
             return ErrorTable.size();
         }
 
-        int query(uint64_t e){
-            if(ErrorTable.find(e)==ErrorTable.end()){
+        int query(const Key & e) const {
+            auto it = ErrorTable.find(e);
+            if(it == ErrorTable.end()){
                 return -1;
             }
-            return ErrorTable[e];
+            return it->second;
         }
         
-        void insert(uint64_t e, uint32_t classid){
+        void insert(const Key & e, uint32_t classid){
             ErrorTable.insert(make_pair(e, classid));
         }
     }OverFlowTable;
@@ -202,61 +254,22 @@ private:
     VerboseBuckets old_buckets[bucket_num];
     // v_buckets就是node节点，这里有bucket_num个
 
-    // 这两个sync函数是为了实现2bit的空间占用，把四个v_bucket放到一个uint8_t的bucket里面
+    // 这两个sync函数是为了实现紧凑的空间占用，把v_bucket的颜色打包到buckets里面, see color_storage.h
     void synchronize_all(){
         memset(buckets, 0, sizeof(buckets));
         for (int i = 0; i < bucket_num; ++i) {
-            if (COLOR_NUM == 3) {
-                int bucket_id = i / 5;
-                const int val_table[] = {
-                        1, 3, 9, 27, 81,
-                };
-                buckets[bucket_id] += v_buckets[i].color * val_table[i % 5];
-            } else if (COLOR_NUM == 4) {
-                int bucket_id = i / 4;
-                buckets[bucket_id] |= ((v_buckets[i].color & 0x3) << ((i % 4) * 2));
-            } else {
-                buckets[i] = uint8_t(v_buckets[i].color);
-            }
+            Storage::set(buckets, i, v_buckets[i].color);
         }
     }
 
     void synchronize(int i){
-        if (COLOR_NUM == 3) {
-            int bucket_id = i / 5;
-            int pos = i % 5;
-            const int val_table[] = {
-                    1, 3, 9, 27, 81,
-            };
-            int old_val = (buckets[bucket_id] / val_table[pos]) % 3;
-            buckets[bucket_id] += (v_buckets[i].color - old_val) * val_table[i % 5];
-        } else if (COLOR_NUM == 4) {
-            int bucket_id = i / 4;
-            buckets[bucket_id] &= ~((0x3) << ((i % 4) * 2));
-            buckets[bucket_id] |= ((v_buckets[i].color & 0x3) << ((i % 4) * 2));
-        } else {
-            buckets[i] = uint8_t(v_buckets[i].color);
-        }
+        Storage::set(buckets, i, v_buckets[i].color);
     }
 
 protected:
-    inline int get_bucket_val(int idx)
+    inline int get_bucket_val(int idx) const
     {
-        // return v_buckets directly
-        return v_buckets[idx].color;
-        /* 
-        if (COLOR_NUM == 3) {
-            int bucket_id = idx / 5;
-            const int val_table[] = {
-                    1, 3, 9, 27, 81
-            };
-            return (buckets[bucket_id] / val_table[idx % 5]) % 3;
-        } else if (COLOR_NUM == 4) {
-            int bucket_id = idx / 4;
-            return (buckets[bucket_id] >> ((idx % 4) * 2)) & 0x3;
-        } else {
-            return buckets[idx];
-        }*/
+        return Storage::get(buckets, idx);
     }
 public:
     struct updatecc{
@@ -378,42 +391,46 @@ private:
             "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
         }
 
-        // try a more aggressive way to color
-        VerboseGroup ** rotate_queue = new VerboseGroup*[2 * groups.size() + 1];
-        for (int i = 0; i < (int)groups.size(); ++i) {
-            rotate_queue[i] = groups[i];
-            rotate_queue[i]->visited = false;
-            rotate_queue[i]->remained_neighbour_num = int(rotate_queue[i]->neighbours.size());
-        }
-        int start = 0, end = int(groups.size());
-        while (start != end) {
-            VerboseGroup * g = rotate_queue[start++];
-            if (g->remained_neighbour_num < COLOR_NUM) {
-                sorted[tot_deleted++] = g;
-                g->deleted = true;
-                for (VerboseGroup * n: g->neighbours) {
-                    if (n->deleted || n->remained_neighbour_num < COLOR_NUM)
-                        continue;
-                    n->remained_neighbour_num -= 1;
-                    if (n->visited && n->remained_neighbour_num == COLOR_NUM - 1)
-                    {
-                        rotate_queue[end++] = n;
+        {
+            PhaseTimer timer(build_profile, PHASE_PEELING);
+            // try a more aggressive way to color
+            VerboseGroup ** rotate_queue = new VerboseGroup*[2 * groups.size() + 1];
+            for (int i = 0; i < (int)groups.size(); ++i) {
+                rotate_queue[i] = groups[i];
+                rotate_queue[i]->visited = false;
+                rotate_queue[i]->remained_neighbour_num = int(rotate_queue[i]->neighbours.size());
+            }
+            int start = 0, end = int(groups.size());
+            while (start != end) {
+                VerboseGroup * g = rotate_queue[start++];
+                if (g->remained_neighbour_num < COLOR_NUM) {
+                    sorted[tot_deleted++] = g;
+                    g->deleted = true;
+                    for (VerboseGroup * n: g->neighbours) {
+                        if (n->deleted || n->remained_neighbour_num < COLOR_NUM)
+                            continue;
+                        n->remained_neighbour_num -= 1;
+                        if (n->visited && n->remained_neighbour_num == COLOR_NUM - 1)
+                        {
+                            rotate_queue[end++] = n;
 
+                        }
                     }
+                } 
+                else {
+                    g->visited = true;
                 }
-            } 
-            else {
-                g->visited = true;
+                start %= (groups.size() + 1);
+                end %= (groups.size() + 1);
             }
-            start %= (groups.size() + 1);
-            end %= (groups.size() + 1);
+            delete[] rotate_queue;
         }
-        delete rotate_queue;
 
         if (tot_deleted != (int)groups.size()) {
             return false;
         }
 
+        PhaseTimer timer(build_profile, PHASE_COLORING);
         for (int i = groups.size() - 1; i >= 0; --i) {
             int c = -1;
             VerboseGroup * g = sorted[i];
@@ -451,37 +468,40 @@ COLOR_FAILED:
         vector<VerboseGroup *> groups;
         unordered_map<void *, VerboseGroup *> dict;
 
-        groups.clear();
-        dict.clear();
+        {
+            PhaseTimer timer(build_profile, PHASE_GROUP_COLLECT);
+            groups.clear();
+            dict.clear();
 
-        for (int i = 0; i < bucket_num; ++i) {
-            VerboseBuckets * p = &v_buckets[i];
-            if (dict.find(p->get_root_bucket()) == dict.end()) {
-                auto vgp = dict[p->get_root_bucket()] = new VerboseGroup();
-                groups.push_back(vgp);
-                // group is linked to its root bucket, which is also the key of dict
-                vgp->back_pointer = p->get_root_bucket();
-                // create link between root_bucket and its group
-                p->get_root_bucket()->group.back_pointer = p->get_root_bucket();
+            for (int i = 0; i < bucket_num; ++i) {
+                VerboseBuckets * p = &v_buckets[i];
+                if (dict.find(p->get_root_bucket()) == dict.end()) {
+                    auto vgp = dict[p->get_root_bucket()] = new VerboseGroup();
+                    groups.push_back(vgp);
+                    // group is linked to its root bucket, which is also the key of dict
+                    vgp->back_pointer = p->get_root_bucket();
+                    // create link between root_bucket and its group
+                    p->get_root_bucket()->group.back_pointer = p->get_root_bucket();
+                }
             }
-        }
 
-        for (int i = 0; i < bucket_num; ++i) {
-            VerboseBuckets * p = &v_buckets[i];
-            // Go through all pos_edges linked to the bucket
-            for (CCEdge * e: p->pos_edges) {
-                if (!e->available) continue;
-                // the other node
-                uint32_t other = e->get_other_val(uint32_t(i));
-                auto vgp = dict[p->get_root_bucket()];
-                // 这两个group之间有边，表示颜色应该不一致
-                vgp->neighbours.insert(dict[v_buckets[other].get_root_bucket()]);
-                // insert neighbours to group
-                p->get_root_bucket()->group.neighbours.insert(&(v_buckets[other].get_root_bucket()->group));
+            for (int i = 0; i < bucket_num; ++i) {
+                VerboseBuckets * p = &v_buckets[i];
+                // Go through all pos_edges linked to the bucket
+                for (CCEdge * e: p->pos_edges) {
+                    if (!e->available) continue;
+                    // the other node
+                    uint32_t other = e->get_other_val(uint32_t(i));
+                    auto vgp = dict[p->get_root_bucket()];
+                    // 这两个group之间有边，表示颜色应该不一致
+                    vgp->neighbours.insert(dict[v_buckets[other].get_root_bucket()]);
+                    // insert neighbours to group
+                    p->get_root_bucket()->group.neighbours.insert(&(v_buckets[other].get_root_bucket()->group));
+                }
             }
         }
 
-        if (1) {
+        if (verbose) {
             unordered_map<void *, int> counter;
             for (int i = 0; i < bucket_num; ++i) {
                 counter[v_buckets[i].get_root_bucket()]++;
@@ -701,6 +721,8 @@ COLOR_FAILED:
             }
         }
         
+        insert_stats.record_recolor(turn, node_num_to_update);
+
         // failed
         if(!success){
             return success;
@@ -726,81 +748,90 @@ COLOR_FAILED:
         return false;
     }
 
-public:
-    ColoringClassifier() {
+    void init_buckets()
+    {
         name = "CC" + string(1, char('0' + COLOR_NUM));
         edge_collision_num = 0;
         affected_node_num = 0;
+        collision_time = 0;
         memset(buckets, 0, sizeof(buckets));
-        delete hash1;
-        delete hash2;
-        hash1 = NULL;
-        hash2 = NULL;
-        if (!hash1) {
-            srand(time(0));
-            hash1 = new BOBHash(rand());
-            hash2 = new BOBHash(rand());
-        }
         for(int i = 0; i < BUCKET_NUM; i++){
             v_buckets[i].bucket_id = i;
         }
+    }
+
+public:
+    // seeds are drawn from a per-instance rng
+    ColoringClassifier() : hash1(0), hash2(0), rng(random_device()()) {
+        init_buckets();
+        random_set_hash();
+    };
+
+    // explicit seeds, rehashing during build() is then reproducible as well
+    ColoringClassifier(uint32_t seed1, uint32_t seed2) : hash1(seed1), hash2(seed2), rng(seed1 * 0x9e3779b9u ^ seed2) {
+        init_buckets();
     };
 
     void random_set_hash(){
-        srand(time(0));
-        if (hash1) {
-            delete hash1;
-            hash1 = NULL;
-        }
-        if (hash2) {
-            delete hash2;
-            hash2 = NULL;
-        }
-        hash1 = new BOBHash(rand());
-        hash2 = new BOBHash(rand());
+        hash1 = BOBHash(uint32_t(rng()));
+        hash2 = BOBHash(uint32_t(rng()));
     }
-    
-    void random_set_hash(uint32_t offset){
-        srand(time(0) + 1000 * offset);
-        if (hash1) {
-            delete hash1;
-            hash1 = NULL;
-        }
-        if (hash2) {
-            delete hash2;
-            hash2 = NULL;
-        }
-        hash1 = new BOBHash(rand());
-        // cout << hash1 -> seed << endl;
-        hash2 = new BOBHash(rand());
-        // cout << hash2 -> seed << endl;
+
+    void set_hash_seed(uint32_t seed1, uint32_t seed2){
+        hash1 = BOBHash(seed1);
+        hash2 = BOBHash(seed2);
+    }
+
+    pair<uint32_t, uint32_t> get_hash_seed() const {
+        return make_pair(hash1.seed, hash2.seed);
     }
+
     // INT to construct the CC
-    void set_pos_edge(uint64_t * items, int num) {
+    void set_pos_edge(const Key * items, int num) {
+        PhaseTimer timer(build_profile, PHASE_HASHING);
         pos_edges.resize(num);
         for (int i = 0; i < num; ++i) {
-            pos_edges[i] = new CCEdge(items[i]);
+            pos_edges[i] = new CCEdge(items[i], hash1, hash2);
         }
     };
-    // STR to construct the CC
+    // STR to construct the CC, the strings are not copied and must outlive the classifier
+    void set_pos_edge(const string_view * items, int num) {
+        PhaseTimer timer(build_profile, PHASE_HASHING);
+        pos_edges.resize(num);
+        for (int i = 0; i < num; ++i) {
+            pos_edges[i] = new CCEdge(items[i], hash1, hash2);
+        }
+    }
+
     void set_pos_edge(const char items[][MAX_LEN], int num) {
+        PhaseTimer timer(build_profile, PHASE_HASHING);
         pos_edges.resize(num);
         for (int i = 0; i < num; ++i) {
-            pos_edges[i] = new CCEdge(items[i]);
+            pos_edges[i] = new CCEdge(string_view(items[i]), hash1, hash2);
         }
     }
 
-    void set_neg_edge(uint64_t * items, int num) {
+    void set_neg_edge(const Key * items, int num) {
+        PhaseTimer timer(build_profile, PHASE_HASHING);
         neg_edges.resize(num);
         for (int i = 0; i < num; ++i) {
-            neg_edges[i] = new CCEdge(items[i]);
+            neg_edges[i] = new CCEdge(items[i], hash1, hash2);
+        }
+    }
+
+    void set_neg_edge(const string_view * items, int num) {
+        PhaseTimer timer(build_profile, PHASE_HASHING);
+        neg_edges.resize(num);
+        for (int i = 0; i < num; ++i) {
+            neg_edges[i] = new CCEdge(items[i], hash1, hash2);
         }
     }
 
     void set_neg_edge(const char items[][MAX_LEN], int num) {
+        PhaseTimer timer(build_profile, PHASE_HASHING);
         neg_edges.resize(num);
         for (int i = 0; i < num; ++i) {
-            neg_edges[i] = new CCEdge(items[i]);
+            neg_edges[i] = new CCEdge(string_view(items[i]), hash1, hash2);
         }
     }
 
@@ -827,13 +858,14 @@ public:
                     cur_bucket->group.back_pointer = cur_bucket;
                 }
                 // reset hash
-                random_set_hash(collision_time);
+                random_set_hash();
+                PhaseTimer timer(build_profile, PHASE_HASHING);
                 // printf("rehash for neg_edge...\n");
                 for (auto & edge: neg_edges){
                     CCEdge * e = edge;
                     e->available = true;
                     // cout << e->hash_val_a <<" "<< e->hash_val_b << endl;
-                    e->set_hash_val(e->e);
+                    e->rehash(hash1, hash2);
                     // cout << e->hash_val_a <<" "<< e->hash_val_b << endl;
                 }
                 // printf("rehash for pos_edge...\n");
@@ -841,42 +873,48 @@ public:
                     CCEdge * e = edge;
                     e->available = true;
                     // cout << e->hash_val_a <<" "<< e->hash_val_b << endl;
-                    e->set_hash_val(e->e);
+                    e->rehash(hash1, hash2);
                     // cout << e->hash_val_a <<" "<< e->hash_val_b << endl;
                 }
             }
             
             // two bucket linked with negedge will be set same color 
-            if (verbose) fprintf(stderr, "set neg edge.\n");
-            for (auto & edge: neg_edges) {
-                CCEdge * e = edge;
-                auto bucket_a = &v_buckets[e->hash_val_a];
-                auto bucket_b = &v_buckets[e->hash_val_b];
+            {
+                PhaseTimer timer(build_profile, PHASE_NEG_UNION);
+                if (verbose) fprintf(stderr, "set neg edge.\n");
+                for (auto & edge: neg_edges) {
+                    CCEdge * e = edge;
+                    auto bucket_a = &v_buckets[e->hash_val_a];
+                    auto bucket_b = &v_buckets[e->hash_val_b];
 
-                bucket_a->neg_edges.push_back(e);
-                bucket_b->neg_edges.push_back(e);
+                    bucket_a->neg_edges.push_back(e);
+                    bucket_b->neg_edges.push_back(e);
 
-                if (bucket_a->get_root_bucket() != bucket_b->get_root_bucket()) {
-                    bucket_b->set_root_bucket(bucket_a->get_root_bucket());
+                    if (bucket_a->get_root_bucket() != bucket_b->get_root_bucket()) {
+                        bucket_b->set_root_bucket(bucket_a->get_root_bucket());
+                    }
                 }
             }
 
             // check pos unordered_set available
-            if (verbose) fprintf(stderr, "set pos edge.\n");
-            for (auto & edge: pos_edges) {
-                CCEdge * e = edge;
-                auto bucket_a = &v_buckets[e->hash_val_a];
-                auto bucket_b = &v_buckets[e->hash_val_b];
-
-                bucket_a->pos_edges.push_back(e);
-                bucket_b->pos_edges.push_back(e);
-
-                // edge collision means that there is certainly an error at last
-                if (bucket_a->get_root_bucket() == bucket_b->get_root_bucket()) {
-                    edge_collision_num += 1;
-                    e->available = false;
-                    // 1 for posedge
-                    OverFlowTable.insert(e->e, 1);
+            {
+                PhaseTimer timer(build_profile, PHASE_POS_CHECK);
+                if (verbose) fprintf(stderr, "set pos edge.\n");
+                for (auto & edge: pos_edges) {
+                    CCEdge * e = edge;
+                    auto bucket_a = &v_buckets[e->hash_val_a];
+                    auto bucket_b = &v_buckets[e->hash_val_b];
+
+                    bucket_a->pos_edges.push_back(e);
+                    bucket_b->pos_edges.push_back(e);
+
+                    // edge collision means that there is certainly an error at last
+                    if (bucket_a->get_root_bucket() == bucket_b->get_root_bucket()) {
+                        edge_collision_num += 1;
+                        e->available = false;
+                        // 1 for posedge
+                        OverFlowTable.insert(e->e, 1);
+                    }
                 }
             }
             // at the begining of the while loop, initial what has been changed
@@ -891,17 +929,32 @@ public:
         
         // If there's still edge_collision after MAX_EDGE_COLLISION_TIME,
         // we ignore the collision and endure some error.
+        build_profile.attempts += collision_time + (collision_time < MAX_EDGE_COLLISION_TIME);
         bool color_result = try_color_all();
         if (!color_result) {
+            build_profile.ok = false;
             return false;
         }
-        synchronize_all();
+        {
+            PhaseTimer timer(build_profile, PHASE_SYNC);
+            synchronize_all();
+        }
 
+        build_profile.ok = true;
         return true;
     }
 
 // #define insertDubug
-    bool insert(uint64_t item, int class_id){
+    bool insert(const Key & item, int class_id){
+        uint64_t t0 = stats_now_ns();
+        InsertOutcome outcome = INSERT_NOOP;
+        bool flag = insert_edge(item, class_id, outcome);
+        insert_stats.record(outcome, stats_now_ns() - t0);
+        return flag;
+    }
+
+private:
+    bool insert_edge(const Key & item, int class_id, InsertOutcome & outcome){
         // for(int i = 0; i < BUCKET_NUM; i++){
             // old_buckets[i] = v_buckets[i];
             // old_buckets[i].root_bucket = &old_buckets[v_buckets[i].root_bucket-v_buckets];
@@ -912,7 +965,7 @@ public:
         
         if (class_id == 1) {
             // if insert an pos edge
-            CCEdge * e = new CCEdge(item);
+            CCEdge * e = new CCEdge(item, hash1, hash2);
             pos_edges.push_back(e);
 
             auto bucket_a = &v_buckets[e->hash_val_a];
@@ -932,6 +985,7 @@ public:
                 #ifdef insertDebug
                 cout << "Pos edge with edge collision has been inserted into oftable." <<endl;
                 #endif
+                outcome = INSERT_OVERFLOW;
                 return true;
             }
 
@@ -953,11 +1007,13 @@ public:
             
             bool flag = try_color_two_bucket(bucket_a, bucket_b);
             if(flag){
+                outcome = INSERT_RECOLOR_OK;
                 return flag;
             }
             // failed
             else{
-                cout << "Pos edge recolor failed." <<endl;
+                if (verbose) cout << "Pos edge recolor failed." <<endl;
+                outcome = INSERT_RECOLOR_FAIL;
                 e->available = false;
                 edge_collision_num += 1;
                 OverFlowTable.insert(item, class_id);
@@ -969,7 +1025,7 @@ public:
             }
         } 
         else {
-            neg_edges.push_back(new CCEdge(item));
+            neg_edges.push_back(new CCEdge(item, hash1, hash2));
             CCEdge * e = neg_edges.back();
 
             auto bucket_a = &v_buckets[e->hash_val_a];
@@ -995,6 +1051,7 @@ public:
                 #ifdef insertDebug
                 cout <<"neg edge with edge collision has been inserted into oftable." <<endl;
                 #endif
+                outcome = INSERT_OVERFLOW;
                 
                 return true;
             }
@@ -1013,6 +1070,7 @@ public:
                 #ifdef insertDebug
                 cout <<"Do nothing." <<endl;
                 #endif
+                outcome = INSERT_MERGE;
                 return true;
             }
 
@@ -1037,10 +1095,12 @@ public:
             #endif
             bool flag = try_color_two_bucket(bucket_a);
             if(flag){
+                outcome = INSERT_RECOLOR_OK;
                 return flag;
             }
             else{
-                cout << "Neg edge recolor failed." <<endl;
+                if (verbose) cout << "Neg edge recolor failed." <<endl;
+                outcome = INSERT_RECOLOR_FAIL;
                 e->available = false;
                 edge_collision_num += 1;
                 OverFlowTable.insert(item, class_id);
@@ -1086,36 +1146,288 @@ public:
         }
     }
 
-    int query(uint64_t item) {
-        CCEdge e;
-        e.set_hash_val(item);
+public:
+    int query(const Key & item) const {
+        uint32_t a, b;
+        cc_hash_pair(item, hash1, hash2, bucket_num, a, b);
 
         int c1, c2;
-        c1 = get_bucket_val(e.hash_val_a);
-        c2 = get_bucket_val(e.hash_val_b);
+        c1 = get_bucket_val(a);
+        c2 = get_bucket_val(b);
 
         return c1 == c2;
     }
 
-    int query(const char * item){
-        CCEdge e;
-        e.set_hash_val(item);
+    int query(string_view item) const {
+        uint32_t a, b;
+        cc_hash_pair(item, hash1, hash2, bucket_num, a, b);
 
         int c1, c2;
-        c1 = get_bucket_val(e.hash_val_a);
-        c2 = get_bucket_val(e.hash_val_b);
+        c1 = get_bucket_val(a);
+        c2 = get_bucket_val(b);
 
         return c1 == c2;
     }
 
     // 直接构造keys，values是一半一半
-    bool exp_build(uint64_t * keys, int num){
+    bool exp_build(Key * keys, int num){
         set_pos_edge(keys, num / 2);
         set_neg_edge(keys + num / 2, num - (num / 2));
 
         return build();
     }
 
+    // save the complete insert-capable state, the format is described in snapshot.h
+    bool save(const char * path) const
+    {
+        SnapshotWriter w;
+        w.put(hash1.seed);
+        w.put(hash2.seed);
+        w.put<int32_t>(edge_collision_num);
+        w.put<int32_t>(collision_time);
+
+        // edges are referred to by their index, pos edges first
+        unordered_map<const CCEdge *, uint32_t> edge_id;
+        vector<SnapshotEdge> edges;
+        vector<Key> edge_keys;
+        edge_id.reserve(pos_edges.size() + neg_edges.size());
+        edges.reserve(pos_edges.size() + neg_edges.size());
+        edge_keys.reserve(pos_edges.size() + neg_edges.size());
+        for (auto list: {&pos_edges, &neg_edges}) {
+            for (const CCEdge * e: *list) {
+                edge_id[e] = uint32_t(edges.size());
+                SnapshotEdge se = {e->hash_val_a, e->hash_val_b, e->available};
+                edges.push_back(se);
+                edge_keys.push_back(e->e);
+            }
+        }
+        w.put<uint64_t>(pos_edges.size());
+        w.put<uint64_t>(neg_edges.size());
+        w.put_array(edges.data(), edges.size());
+        w.put_array(edge_keys.data(), edge_keys.size());
+
+        vector<SnapshotBucket> bks(bucket_num);
+        for (int i = 0; i < bucket_num; ++i) {
+            const VerboseBuckets & b = v_buckets[i];
+            bks[i].color = b.color;
+            bks[i].root_bucket = int32_t(b.root_bucket - v_buckets);
+            bks[i].next_bucket = b.next_bucket ? int32_t(b.next_bucket - v_buckets) : -1;
+            bks[i].last_son = int32_t(b.last_son - v_buckets);
+            bks[i].group_color = b.group.color;
+        }
+        w.put_array(bks.data(), bks.size());
+
+        // per bucket lists as offsets + ids
+        vector<uint64_t> offsets(bucket_num + 1);
+        vector<uint32_t> ids;
+        for (int list = 0; list < 3; ++list) {
+            ids.clear();
+            for (int i = 0; i < bucket_num; ++i) {
+                offsets[i] = ids.size();
+                const VerboseBuckets & b = v_buckets[i];
+                if (list == 0) {
+                    for (const CCEdge * e: b.pos_edges) ids.push_back(edge_id[e]);
+                } else if (list == 1) {
+                    for (const CCEdge * e: b.neg_edges) ids.push_back(edge_id[e]);
+                } else {
+                    for (const VerboseGroup * n: b.group.neighbours) ids.push_back(uint32_t(n->back_pointer - v_buckets));
+                }
+            }
+            offsets[bucket_num] = ids.size();
+            w.put_array(offsets.data(), offsets.size());
+            w.put_array(ids.data(), ids.size());
+        }
+
+        vector<Key> overflow_keys;
+        vector<uint32_t> overflow_classes;
+        overflow_keys.reserve(OverFlowTable.ErrorTable.size());
+        overflow_classes.reserve(OverFlowTable.ErrorTable.size());
+        for (auto & kv: OverFlowTable.ErrorTable) {
+            overflow_keys.push_back(kv.first);
+            overflow_classes.push_back(kv.second);
+        }
+        w.put<uint64_t>(overflow_keys.size());
+        w.put_array(overflow_keys.data(), overflow_keys.size());
+        w.put_array(overflow_classes.data(), overflow_classes.size());
+
+        return w.write_file(path, bucket_num, COLOR_NUM, sizeof(Key));
+    }
+
+    // replace the current state with a snapshot written by save()
+    bool load(const char * path)
+    {
+        SnapshotReader r;
+        if (!r.read_file(path, bucket_num, COLOR_NUM, sizeof(Key))) {
+            return false;
+        }
+
+        uint32_t seed1 = 0, seed2 = 0;
+        int32_t collision_num = 0, collision_t = 0;
+        uint64_t pos_num = 0, neg_num = 0;
+        r.get(seed1);
+        r.get(seed2);
+        r.get(collision_num);
+        r.get(collision_t);
+        r.get(pos_num);
+        r.get(neg_num);
+
+        vector<SnapshotEdge> edges;
+        vector<Key> edge_keys;
+        vector<SnapshotBucket> bks(bucket_num);
+        vector<uint64_t> offsets[3];
+        vector<uint32_t> ids[3];
+        uint64_t overflow_num = 0;
+        vector<Key> overflow_keys;
+        vector<uint32_t> overflow_classes;
+
+        bool ok = pos_num + neg_num < (1ull << 32);
+        if (ok) {
+            edges.resize(pos_num + neg_num);
+            edge_keys.resize(pos_num + neg_num);
+            ok = r.get_array(edges.data(), edges.size()) && r.get_array(edge_keys.data(), edge_keys.size()) &&
+                 r.get_array(bks.data(), bks.size());
+        }
+        for (int list = 0; list < 3 && ok; ++list) {
+            offsets[list].resize(bucket_num + 1);
+            ok = r.get_array(offsets[list].data(), offsets[list].size()) && offsets[list][bucket_num] < (1ull << 32);
+            if (ok) {
+                ids[list].resize(offsets[list][bucket_num]);
+                ok = r.get_array(ids[list].data(), ids[list].size());
+            }
+            uint64_t bound = (list == 2) ? uint64_t(bucket_num) : edges.size();
+            for (int i = 0; i < bucket_num && ok; ++i) {
+                ok = offsets[list][i] <= offsets[list][i + 1];
+            }
+            for (size_t i = 0; i < ids[list].size() && ok; ++i) {
+                ok = ids[list][i] < bound;
+            }
+        }
+        if (ok && r.get(overflow_num) && overflow_num < (1ull << 32)) {
+            overflow_keys.resize(overflow_num);
+            overflow_classes.resize(overflow_num);
+            ok = r.get_array(overflow_keys.data(), overflow_keys.size()) &&
+                 r.get_array(overflow_classes.data(), overflow_classes.size()) && r.done();
+        } else {
+            ok = false;
+        }
+        for (int i = 0; i < bucket_num && ok; ++i) {
+            const SnapshotBucket & b = bks[i];
+            ok = b.root_bucket >= 0 && b.root_bucket < bucket_num && b.last_son >= 0 && b.last_son < bucket_num &&
+                 b.next_bucket >= -1 && b.next_bucket < bucket_num;
+        }
+        for (size_t i = 0; i < edges.size() && ok; ++i) {
+            ok = edges[i].hash_val_a < uint32_t(bucket_num) && edges[i].hash_val_b < uint32_t(bucket_num);
+        }
+        if (!ok) {
+            fprintf(stderr, "Snapshot %s has an invalid payload\n", path);
+            return false;
+        }
+
+        // everything is checked, replace the current state
+        for (auto e: pos_edges) {
+            delete e;
+        }
+        for (auto e: neg_edges) {
+            delete e;
+        }
+        pos_edges.resize(pos_num);
+        neg_edges.resize(neg_num);
+        vector<CCEdge *> all_edges(edges.size());
+        for (size_t i = 0; i < edges.size(); ++i) {
+            CCEdge * e = new CCEdge();
+            e->e = edge_keys[i];
+            e->hash_val_a = edges[i].hash_val_a;
+            e->hash_val_b = edges[i].hash_val_b;
+            e->available = edges[i].available;
+            all_edges[i] = e;
+            if (i < pos_num) {
+                pos_edges[i] = e;
+            } else {
+                neg_edges[i - pos_num] = e;
+            }
+        }
+
+        set_hash_seed(seed1, seed2);
+        edge_collision_num = collision_num;
+        collision_time = collision_t;
+
+        for (int i = 0; i < bucket_num; ++i) {
+            VerboseBuckets & b = v_buckets[i];
+            b.bucket_id = i;
+            b.color = bks[i].color;
+            b.root_bucket = &v_buckets[bks[i].root_bucket];
+            b.next_bucket = bks[i].next_bucket == -1 ? NULL : &v_buckets[bks[i].next_bucket];
+            b.last_son = &v_buckets[bks[i].last_son];
+
+            b.pos_edges.clear();
+            b.neg_edges.clear();
+            for (uint64_t j = offsets[0][i]; j < offsets[0][i + 1]; ++j) b.pos_edges.push_back(all_edges[ids[0][j]]);
+            for (uint64_t j = offsets[1][i]; j < offsets[1][i + 1]; ++j) b.neg_edges.push_back(all_edges[ids[1][j]]);
+
+            b.group = VerboseGroup();
+            b.group.color = bks[i].group_color;
+            b.group.back_pointer = &b;
+            b.group.neighbours.reserve(offsets[2][i + 1] - offsets[2][i]);
+            for (uint64_t j = offsets[2][i]; j < offsets[2][i + 1]; ++j) b.group.neighbours.insert(&v_buckets[ids[2][j]].group);
+        }
+
+        OverFlowTable.ErrorTable.clear();
+        OverFlowTable.ErrorTable.reserve(overflow_keys.size());
+        for (size_t i = 0; i < overflow_keys.size(); ++i) {
+            OverFlowTable.insert(overflow_keys[i], overflow_classes[i]);
+        }
+
+        synchronize_all();
+        return true;
+    }
+
+    // write the query-only image read by MappedColoringClassifier, see query_image.h
+    bool save_image(const char * path, uint32_t offset_num = 1) const
+    {
+        ImageHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, image_magic, sizeof(header.magic));
+        header.version = IMAGE_VERSION;
+        header.color_num = COLOR_NUM;
+        header.bucket_num = bucket_num;
+        header.offset_num = offset_num;
+        header.seed1 = hash1.seed;
+        header.seed2 = hash2.seed;
+        header.key_size = sizeof(Key);
+        header.buckets_offset = image_align(sizeof(header), IMAGE_ALIGN);
+        header.buckets_size = sizeof(buckets);
+        header.overflow_offset = image_align(header.buckets_offset + header.buckets_size, IMAGE_ALIGN);
+        header.overflow_num = OverFlowTable.ErrorTable.size();
+        header.file_size = header.overflow_offset + header.overflow_num * sizeof(ImageOverflow<Key>);
+
+        vector<ImageOverflow<Key>> overflow(header.overflow_num);
+        memset((void *)overflow.data(), 0, overflow.size() * sizeof(ImageOverflow<Key>));
+        size_t n = 0;
+        for (auto & kv: OverFlowTable.ErrorTable) {
+            overflow[n].key = kv.first;
+            overflow[n].class_id = kv.second;
+            ++n;
+        }
+        sort(overflow.begin(), overflow.end(), [](const ImageOverflow<Key> & a, const ImageOverflow<Key> & b) {
+            return key_less(a.key, b.key);
+        });
+
+        FILE * f = fopen(path, "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot open %s for writing\n", path);
+            return false;
+        }
+        vector<char> padding(IMAGE_ALIGN, 0);
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(padding.data(), 1, header.buckets_offset - sizeof(header), f) == header.buckets_offset - sizeof(header) &&
+                  fwrite(buckets, 1, header.buckets_size, f) == header.buckets_size &&
+                  fwrite(padding.data(), 1, header.overflow_offset - header.buckets_offset - header.buckets_size, f) ==
+                          header.overflow_offset - header.buckets_offset - header.buckets_size &&
+                  fwrite(overflow.data(), sizeof(ImageOverflow<Key>), overflow.size(), f) == overflow.size();
+        ok = (fclose(f) == 0) && ok;
+        return ok;
+    }
+
     // 初始化，设置v_buckets的color
     void init(){
         for (int i = 0; i < bucket_num; ++i) {
@@ -1123,6 +1435,36 @@ public:
         }
     }
 
+    // the packed colors are what queries read; v_buckets, old_buckets, the edges, the per-bucket
+    // edge lists and the group neighbour sets are only kept to build and insert, see memory_usage.h.
+    // Walks all buckets, O(bucket_num).
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.query_bytes = sizeof(buckets);
+        // the rest of the object: the counters, the profiles and the container headers
+        m.build_bytes = sizeof(*this) - sizeof(buckets);
+        m.overhead_bytes = huge_alloc_bytes(sizeof(*this)) - sizeof(*this);
+
+        m.build_bytes += (pos_edges.size() + neg_edges.size()) * sizeof(CCEdge);
+        m.overhead_bytes += (pos_edges.size() + neg_edges.size()) * (malloc_chunk_bytes(sizeof(CCEdge)) - sizeof(CCEdge));
+        add_vector_usage(m, &MemoryUsage::build_bytes, pos_edges);
+        add_vector_usage(m, &MemoryUsage::build_bytes, neg_edges);
+        for (const VerboseBuckets * vb: {v_buckets, old_buckets}) {
+            for (int i = 0; i < bucket_num; ++i) {
+                add_vector_usage(m, &MemoryUsage::build_bytes, vb[i].pos_edges);
+                add_vector_usage(m, &MemoryUsage::build_bytes, vb[i].neg_edges);
+                add_hash_table_usage(m, &MemoryUsage::build_bytes, vb[i].group.neighbours);
+            }
+        }
+        add_vector_usage(m, &MemoryUsage::build_bytes, UpdateCC.affected_id);
+
+        // keys with a hash that libstdc++ does not consider fast keep the hash code in the node
+        add_hash_table_usage(m, &MemoryUsage::overflow_bytes, OverFlowTable.ErrorTable,
+                             is_integral<Key>::value ? 0 : sizeof(size_t), true);
+        return m;
+    }
+
     void report()
     {
         printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
@@ -0,0 +1,260 @@
+#ifndef COLORINGCLASSIFER_DATASET_H
+#define COLORINGCLASSIFER_DATASET_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utils.h"
+
+using namespace std;
+
+// A key dump on disk, mapped read-only. Two formats, told apart by the extension:
+//   .dat / .bin   raw little-endian uint64 keys, the format of data/data_bytes. There are no
+//                 classes in the file: key i of n gets class i * class_num / n, contiguous
+//                 blocks like the pos / neg halves test.cpp used to split.
+//   .txt / .csv   one "key,class" per line, key in decimal or 0x hex; blank lines, lines
+//                 starting with '#' and a header line that does not start with a digit are skipped.
+// Binary keys are read straight from the mapping, so a file of any size costs address space
+// and page cache, not heap. Text files are parsed once into keys and classes.
+class Dataset
+{
+public:
+    enum Format { BINARY, TEXT, UNKNOWN };
+
+private:
+    string path;
+    Format format;
+    int fd;
+    const uint8_t * map_base;
+    size_t map_bytes;
+
+    const uint64_t * key_ptr;
+    size_t num;
+    uint32_t class_num;
+    // only for TEXT, binary classes are computed
+    vector<uint64_t> text_keys;
+    vector<uint32_t> text_classes;
+
+    // decimal or 0x hex digits in [p, end), the mapping is not 0-terminated so strtoull can not be used
+    static const char * parse_u64(const char * p, const char * end, uint64_t & val)
+    {
+        val = 0;
+        if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+            for (p += 2; p < end; ++p) {
+                int d = (*p >= '0' && *p <= '9') ? *p - '0' : (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10
+                        : (*p >= 'A' && *p <= 'F') ? *p - 'A' + 10 : -1;
+                if (d < 0) {
+                    break;
+                }
+                val = val * 16 + uint64_t(d);
+            }
+            return p;
+        }
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            val = val * 10 + uint64_t(*p - '0');
+        }
+        return p;
+    }
+
+    bool parse_text()
+    {
+        const char * p = (const char *)map_base;
+        const char * end = p + map_bytes;
+        uint32_t max_class = 0;
+        size_t line_no = 0;
+        while (p < end) {
+            const char * eol = (const char *)memchr(p, '\n', end - p);
+            if (!eol) {
+                eol = end;
+            }
+            line_no++;
+            const char * q = p;
+            while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) {
+                q++;
+            }
+            if (q < eol && *q != '#') {
+                if (*q < '0' || *q > '9') {
+                    if (line_no != 1) {
+                        fprintf(stderr, "%s:%lu: not a key,class line\n", path.c_str(), (unsigned long)line_no);
+                        return false;
+                    }
+                } else {
+                    uint64_t key, cls;
+                    const char * next = parse_u64(q, eol, key);
+                    while (next < eol && (*next == ',' || *next == ' ' || *next == '\t')) {
+                        next++;
+                    }
+                    if (next >= eol || *next < '0' || *next > '9') {
+                        fprintf(stderr, "%s:%lu: missing class\n", path.c_str(), (unsigned long)line_no);
+                        return false;
+                    }
+                    parse_u64(next, eol, cls);
+                    text_keys.push_back(key);
+                    text_classes.push_back(uint32_t(cls));
+                    max_class = max(max_class, uint32_t(cls));
+                }
+            }
+            p = eol + 1;
+        }
+        key_ptr = text_keys.data();
+        num = text_keys.size();
+        class_num = num ? max_class + 1 : 0;
+        return true;
+    }
+
+public:
+    static Format format_of(const string & file)
+    {
+        size_t dot = file.rfind('.');
+        string ext = dot == string::npos ? "" : file.substr(dot);
+        if (ext == ".dat" || ext == ".bin") {
+            return BINARY;
+        }
+        if (ext == ".txt" || ext == ".csv") {
+            return TEXT;
+        }
+        return UNKNOWN;
+    }
+
+    Dataset() : format(UNKNOWN), fd(-1), map_base(NULL), map_bytes(0), key_ptr(NULL), num(0), class_num(0) {}
+
+    Dataset(const Dataset &) = delete;
+    Dataset & operator=(const Dataset &) = delete;
+
+    ~Dataset()
+    {
+        close();
+    }
+
+    // binary_class_num: classes given to the keys of a binary file
+    bool open(const string & _path, uint32_t binary_class_num = 2)
+    {
+        close();
+        path = _path;
+        format = format_of(path);
+        if (format == UNKNOWN) {
+            fprintf(stderr, "%s: unknown dataset format\n", path.c_str());
+            return false;
+        }
+
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot open %s\n", path.c_str());
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            fprintf(stderr, "Cannot stat %s\n", path.c_str());
+            close();
+            return false;
+        }
+        map_bytes = size_t(st.st_size);
+        if (map_bytes) {
+            void * p = mmap(NULL, map_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                fprintf(stderr, "Cannot map %s\n", path.c_str());
+                map_bytes = 0;
+                close();
+                return false;
+            }
+            map_base = (const uint8_t *)p;
+            madvise(p, map_bytes, MADV_SEQUENTIAL);
+        }
+
+        if (format == BINARY) {
+            if (map_bytes % sizeof(uint64_t)) {
+                fprintf(stderr, "%s: %lu trailing bytes ignored\n", path.c_str(),
+                        (unsigned long)(map_bytes % sizeof(uint64_t)));
+            }
+            key_ptr = (const uint64_t *)map_base;
+            num = map_bytes / sizeof(uint64_t);
+            class_num = num ? max(binary_class_num, 1u) : 0;
+            return true;
+        }
+        if (!parse_text()) {
+            close();
+            return false;
+        }
+        // the keys are copied, the text is not needed any more
+        munmap((void *)map_base, map_bytes);
+        map_base = NULL;
+        map_bytes = 0;
+        return true;
+    }
+
+    void close()
+    {
+        if (map_base) {
+            munmap((void *)map_base, map_bytes);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+        map_base = NULL;
+        map_bytes = 0;
+        key_ptr = NULL;
+        num = 0;
+        class_num = 0;
+        text_keys.clear();
+        text_classes.clear();
+    }
+
+    const string & name() const
+    {
+        return path;
+    }
+
+    Format get_format() const
+    {
+        return format;
+    }
+
+    size_t size() const
+    {
+        return num;
+    }
+
+    // 1 + the largest class in the file, or the binary_class_num of open()
+    uint32_t get_class_num() const
+    {
+        return class_num;
+    }
+
+    const uint64_t * keys() const
+    {
+        return key_ptr;
+    }
+
+    inline uint64_t key(size_t i) const
+    {
+        return key_ptr[i];
+    }
+
+    inline uint32_t class_of(size_t i) const
+    {
+        if (format == TEXT) {
+            return text_classes[i];
+        }
+        return uint32_t(__uint128_t(i) * class_num / num);
+    }
+
+    // appends the pairs [begin, end) to kvs, for the engines that build from a KVList
+    void append(KVList & kvs, size_t begin, size_t end) const
+    {
+        kvs.reserve(kvs.size() + (end - begin));
+        for (size_t i = begin; i < end; ++i) {
+            kvs.push_back(make_pair(key_ptr[i], class_of(i)));
+        }
+    }
+};
+
+#endif //COLORINGCLASSIFER_DATASET_H
@@ -0,0 +1,309 @@
+#ifndef COLORINGCLASSIFER_DYNAMIC_BLOOM_FILTER_H
+#define COLORINGCLASSIFER_DYNAMIC_BLOOM_FILTER_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include "bloom_hash.h"
+#include "aligned_array.h"
+#include "memory_usage.h"
+#include "utils.h"
+
+using namespace std;
+
+// Bloom filters sized at run time: bit count, k and class num are constructor arguments and
+// the bits live in an AlignedArray on the heap. The bit layout is the one of the compile-time
+// filters (MultiWayBloomFilter, ShiftingBloomFilter), so both answer every query the same way.
+// k in [1, max_fixed_k] runs an unrolled path picked by dispatch_k, larger k a plain loop;
+// the modulo by the run-time bit count goes through FastMod32.
+// The unrolled paths are kept out of line (one call per key), inlined into the switch
+// they would exhaust the inliner and leave the hash calls of the later probes out of line.
+
+template<typename Key = uint64_t, bool double_hashing = false>
+class DynamicMultiWayBloomFilter
+{
+    // probe_at() does not depend on the k of ProbeHash
+    typedef ProbeHash<Key, 1, double_hashing> RuntimeHash;
+protected:
+    const uint64_t num_bits;
+    const int k;
+    const int way;
+    const uint32_t bit_per_bf;
+    const uint32_t way_mask;
+    FastMod32 mod;
+    AlignedArray<uint32_t> bf;
+
+    template<int K>
+    __attribute__((noinline)) void insert_bf_fixed(const Key & key, int idx)
+    {
+        ProbeHash<Key, K, double_hashing> h(key);
+        for_probes<K>([&](auto i) {
+            uint64_t pos = uint64_t(mod(h.template probe<decltype(i)::value>())) * way + idx;
+            bf[pos / 32] |= 1u << (pos % 32);
+            return true;
+        });
+    }
+
+    __attribute__((always_inline)) inline uint32_t window(uint32_t probe) const
+    {
+        uint64_t pos = uint64_t(mod(probe)) * way;
+        uint64_t item = (uint64_t(bf[pos / 32 + 1]) << 32) | bf[pos / 32];
+        return uint32_t(item >> (pos % 32));
+    }
+
+    template<int K>
+    __attribute__((noinline)) uint32_t query_multiway_fixed(const Key & key) const
+    {
+        ProbeHash<Key, K, double_hashing> h(key);
+        uint32_t ret = way_mask;
+        for_probes<K>([&](auto i) {
+            ret &= window(h.template probe<decltype(i)::value>());
+            return ret != 0;
+        });
+        return ret;
+    }
+
+    void insert_bf(const Key & key, int idx)
+    {
+        if (dispatch_k(k, [&](auto K) { insert_bf_fixed<decltype(K)::value>(key, idx); })) {
+            return;
+        }
+        RuntimeHash h(key);
+        for (int i = 0; i < k; ++i) {
+            uint64_t pos = uint64_t(mod(h.probe_at(i))) * way + idx;
+            bf[pos / 32] |= 1u << (pos % 32);
+        }
+    }
+
+    uint32_t query_multiway(const Key & key) const
+    {
+        uint32_t ret = 0;
+        if (dispatch_k(k, [&](auto K) { ret = query_multiway_fixed<decltype(K)::value>(key); })) {
+            return ret;
+        }
+        RuntimeHash h(key);
+        ret = way_mask;
+        for (int i = 0; i < k && ret; ++i) {
+            ret &= window(h.probe_at(i));
+        }
+        return ret;
+    }
+
+public:
+    DynamicMultiWayBloomFilter(uint64_t _num_bits, int _k, int _way)
+            : num_bits(_num_bits), k(_k), way(_way), bit_per_bf(uint32_t(_num_bits / max(_way, 1))),
+              way_mask(_way >= 32 ? ~0u : (1u << _way) - 1), mod(max(bit_per_bf, 1u)),
+              bf(max(_way, 1) * ((_num_bits / max(_way, 1) + 31) / 32) + 1)
+    {
+        if (way < 1 || way > 32 || k < 1 || (!double_hashing && k > 32) ||
+            num_bits / way == 0 || num_bits / way >= (1ull << 32)) {
+            fprintf(stderr, "Bad multiway bloom filter config: %lu bits, k = %d, way = %d\n",
+                    (unsigned long)num_bits, k, way);
+            exit(-1);
+        }
+    }
+
+    // the filter words; the object itself counts as overhead
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.query_bytes = bf.size_bytes();
+        m.overhead_bytes = huge_alloc_bytes(bf.size_bytes()) - bf.size_bytes() + sizeof(*this);
+        return m;
+    }
+};
+
+template<typename Key = uint64_t, bool double_hashing = false>
+class DynamicMultiBloomFilter: public DynamicMultiWayBloomFilter<Key, double_hashing>
+{
+    typedef DynamicMultiWayBloomFilter<Key, double_hashing> Parent;
+public:
+    const string name;
+    const int _class_num;
+
+    DynamicMultiBloomFilter(uint64_t num_bits, int k, int class_num = 2)
+            : Parent(num_bits, k, class_num), name("DynMultiBF"), _class_num(class_num)
+    {
+    }
+
+    void insert(const Key & key, int class_id)
+    {
+        Parent::insert_bf(key, class_id);
+    }
+
+    // -2 for no class, -1 for several
+    int query(const Key & key) const
+    {
+        uint32_t qr = Parent::query_multiway(key);
+        if (!qr) {
+            return -2;
+        }
+        if (qr & (qr - 1)) {
+            return -1;
+        }
+        return __builtin_ctz(qr);
+    }
+
+    bool build(KeyValueList<Key> & kvs, int num)
+    {
+        for (int i = 0; i < num; ++i) {
+            insert(kvs[i].first, kvs[i].second);
+        }
+        return true;
+    }
+};
+
+template<typename Key = uint64_t, bool double_hashing = false>
+class DynamicCodedBloomFilter: public DynamicMultiWayBloomFilter<Key, double_hashing>
+{
+    typedef DynamicMultiWayBloomFilter<Key, double_hashing> Parent;
+public:
+    const string name;
+    const int _class_num;
+
+    DynamicCodedBloomFilter(uint64_t num_bits, int k, int class_num = 2)
+            : Parent(num_bits, k, log2(class_num)), name("DynCodedBF"), _class_num(class_num)
+    {
+    }
+
+    void insert(const Key & key, int class_id)
+    {
+        for (int idx = 0; class_id; ++idx, class_id /= 2) {
+            if (class_id & 1) {
+                Parent::insert_bf(key, idx);
+            }
+        }
+    }
+
+    int query(const Key & key) const
+    {
+        return Parent::query_multiway(key);
+    }
+
+    bool build(KeyValueList<Key> & kvs, int num)
+    {
+        for (int i = 0; i < num; ++i) {
+            insert(kvs[i].first, kvs[i].second);
+        }
+        return true;
+    }
+};
+
+template<typename Key = uint64_t, bool double_hashing = false>
+class DynamicShiftingBloomFilter
+{
+    typedef ProbeHash<Key, 1, double_hashing> RuntimeHash;
+
+    const uint64_t num_bits;
+    const int k;
+    const uint64_t class_mask;
+    FastMod32 mod;
+    AlignedArray<uint64_t> bf;
+
+    __attribute__((always_inline)) inline uint64_t window(uint64_t pos) const
+    {
+        uint64_t shift = pos % 64;
+        uint64_t lo = bf[pos / 64] >> shift;
+        uint64_t hi = shift ? bf[pos / 64 + 1] << (64 - shift) : 0;
+        return lo | hi;
+    }
+
+    template<int K>
+    __attribute__((noinline)) void insert_bf_fixed(const Key & key, int idx)
+    {
+        ProbeHash<Key, K, double_hashing> h(key);
+        for_probes<K>([&](auto i) {
+            uint64_t pos = mod(h.template probe<decltype(i)::value>()) + idx;
+            bf[pos / 64] |= 1ull << (pos % 64);
+            return true;
+        });
+    }
+
+    template<int K>
+    __attribute__((noinline)) uint64_t query_bf_fixed(const Key & key) const
+    {
+        ProbeHash<Key, K, double_hashing> h(key);
+        uint64_t ret = class_mask;
+        for_probes<K>([&](auto i) {
+            ret &= window(mod(h.template probe<decltype(i)::value>()));
+            return ret != 0;
+        });
+        return ret;
+    }
+
+    uint64_t query_bf(const Key & key) const
+    {
+        uint64_t ret = 0;
+        if (dispatch_k(k, [&](auto K) { ret = query_bf_fixed<decltype(K)::value>(key); })) {
+            return ret;
+        }
+        RuntimeHash h(key);
+        ret = class_mask;
+        for (int i = 0; i < k && ret; ++i) {
+            ret &= window(mod(h.probe_at(i)));
+        }
+        return ret;
+    }
+
+public:
+    const string name;
+    const int _class_num;
+
+    DynamicShiftingBloomFilter(uint64_t _num_bits, int _k, int class_num = 2)
+            : num_bits(_num_bits), k(_k), class_mask(class_num >= 64 ? ~0ull : (1ull << class_num) - 1),
+              mod(max(uint32_t(_num_bits), 1u)), bf((_num_bits + class_num + 63) / 64 + 1), name("DynShiftBF"),
+              _class_num(class_num)
+    {
+        if (class_num < 1 || class_num > 64 || k < 1 || (!double_hashing && k > 32) ||
+            num_bits == 0 || num_bits >= (1ull << 32)) {
+            fprintf(stderr, "Bad shifting bloom filter config: %lu bits, k = %d, class num = %d\n",
+                    (unsigned long)num_bits, k, class_num);
+            exit(-1);
+        }
+    }
+
+    void insert(const Key & key, int class_id)
+    {
+        if (dispatch_k(k, [&](auto K) { insert_bf_fixed<decltype(K)::value>(key, class_id); })) {
+            return;
+        }
+        RuntimeHash h(key);
+        for (int i = 0; i < k; ++i) {
+            uint64_t pos = mod(h.probe_at(i)) + class_id;
+            bf[pos / 64] |= 1ull << (pos % 64);
+        }
+    }
+
+    // -1 for no class, -2 for several
+    int query(const Key & key) const
+    {
+        uint64_t qr = query_bf(key);
+        if (!qr) {
+            return -1;
+        }
+        if (qr & (qr - 1)) {
+            return -2;
+        }
+        return __builtin_ctzll(qr);
+    }
+
+    bool build(KeyValueList<Key> & kvs, int num)
+    {
+        for (int i = 0; i < num; ++i) {
+            insert(kvs[i].first, kvs[i].second);
+        }
+        return true;
+    }
+
+    // the filter words; the object itself counts as overhead
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.query_bytes = bf.size_bytes();
+        m.overhead_bytes = huge_alloc_bytes(bf.size_bytes()) - bf.size_bytes() + sizeof(*this);
+        return m;
+    }
+};
+
+#endif //COLORINGCLASSIFER_DYNAMIC_BLOOM_FILTER_H
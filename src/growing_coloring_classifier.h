@@ -0,0 +1,266 @@
+#ifndef COLORINGCLASSIFER_GROWING_COLORING_CLASSIFIER_H
+#define COLORINGCLASSIFER_GROWING_COLORING_CLASSIFIER_H
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <random>
+#include "shift_coloring_classifier.h"
+#include "utils.h"
+
+using namespace std;
+
+// when to move to the larger embedder
+struct GrowthPolicy
+{
+    double max_overflow_ratio;  // overflow table size / key num
+    double max_failure_ratio;   // failed inserts / inserts
+    int min_inserts;            // the failure ratio is only checked after this many inserts
+
+    GrowthPolicy() : max_overflow_ratio(0.01), max_failure_ratio(0.01), min_inserts(1000) {}
+};
+
+// Two-class embedder that starts with bucket_num buckets and, once the policy is crossed,
+// builds an embedder with grown_bucket_num buckets on a background thread.
+// Queries and inserts keep going to the old one meanwhile, inserts are also logged and replayed
+// into the new one, which is then swapped in. Bucket counts are compile-time, so it grows once.
+// query() may run on other threads during the background build and the swap (poll(),
+// wait_for_growth() or an insert that finishes the growth): a query holds a reference on the small
+// embedder, which is freed by the last one still using it. Inserts need the same exclusion
+// from queries as on ShiftingColoringClassifier.
+// A growth whose build fails (max_retry seeds) is dropped and tried again with new seeds once
+// another policy.min_inserts inserts have gone to the small embedder, see growth_failed().
+template<uint32_t bucket_num, uint32_t grown_bucket_num, uint32_t color_num = 4>
+class GrowingColoringClassifier
+{
+    static_assert(grown_bucket_num > bucket_num, "grown_bucket_num must be larger than bucket_num");
+
+    typedef ShiftingColoringClassifier<bucket_num, color_num, 2> Small;
+    typedef ShiftingColoringClassifier<grown_bucket_num, color_num, 2> Large;
+
+    // read by queries with atomic_load; large is only set by the swap, and kept until destruction
+    shared_ptr<Small> small;
+    Large * large;
+    atomic<bool> swapped;
+
+    // retained keys, the larger embedder is built from a copy of them
+    KVList kvs;
+    // inserts made while the larger embedder is built, replayed before the swap
+    KVList double_written;
+    thread builder;
+    atomic<bool> building, build_done;
+    // written by the builder, read after joining it
+    Large * built;
+    bool build_ok;
+    mt19937 rng;
+
+    int insert_num, insert_failed_num;
+    // growths whose build failed, and the insert_num before which the next one may not start
+    int growth_failed_num, retry_insert_num;
+
+    bool policy_crossed() const
+    {
+        if (kvs.empty()) {
+            return false;
+        }
+        if (small->OverFlowTable.size() > policy.max_overflow_ratio * kvs.size()) {
+            return true;
+        }
+        return insert_num >= policy.min_inserts && insert_failed_num > policy.max_failure_ratio * insert_num;
+    }
+
+    void start_growth()
+    {
+        building = true;
+        build_done = false;
+        uint32_t seed = uint32_t(rng());
+        KVList snapshot = kvs;
+        builder = thread([this, seed](KVList data) {
+            mt19937 gen(seed);
+            Large * l = NULL;
+            bool ok = false;
+            for (int retry = 0; retry < max_retry && !ok; ++retry) {
+                delete l;
+                l = new Large(uint32_t(gen()), uint32_t(gen()));
+                ok = l->build(data, int(data.size()));
+            }
+            if (!ok) {
+                delete l;
+                l = NULL;
+            }
+            built = l;
+            build_ok = ok;
+            build_done.store(true, memory_order_release);
+        }, std::move(snapshot));
+    }
+
+    // called from the inserting thread, replays the log and swaps once the build is done
+    void finish_growth()
+    {
+        builder.join();
+        building = false;
+        if (!build_ok) {
+            double_written.clear();
+            build_done = false;
+            growth_failed_num += 1;
+            retry_insert_num = insert_num + policy.min_inserts;
+            cout << "Growing to " << grown_bucket_num << " buckets failed, retrying after "
+                 << policy.min_inserts << " more inserts." << endl;
+            return;
+        }
+        for (auto & kv: double_written) {
+            built->insert(kv.first, kv.second);
+        }
+        double_written.clear();
+        large = built;
+        built = NULL;
+        swapped.store(true, memory_order_release);
+        // queries still in the small embedder keep it alive until they return
+        atomic_store(&small, shared_ptr<Small>());
+    }
+
+public:
+    string name;
+    constexpr static int _class_num = 2;
+    GrowthPolicy policy;
+    int max_retry = 8;
+
+    GrowingColoringClassifier() : large(NULL), swapped(false), building(false), build_done(false), built(NULL),
+                                  build_ok(false), rng(random_device()()), insert_num(0), insert_failed_num(0),
+                                  growth_failed_num(0), retry_insert_num(0)
+    {
+        small = make_shared<Small>(uint32_t(rng()), uint32_t(rng()));
+        name = "GrowingCC" + string(1, char('0' + color_num));
+    }
+
+    explicit GrowingColoringClassifier(uint32_t seed, GrowthPolicy _policy = GrowthPolicy())
+            : large(NULL), swapped(false), building(false), build_done(false), built(NULL), build_ok(false),
+              rng(seed), insert_num(0), insert_failed_num(0), growth_failed_num(0), retry_insert_num(0),
+              policy(_policy)
+    {
+        small = make_shared<Small>(uint32_t(rng()), uint32_t(rng()));
+        name = "GrowingCC" + string(1, char('0' + color_num));
+    }
+
+    bool build(KVList & data, int num)
+    {
+        kvs.assign(data.begin(), data.begin() + num);
+        return small->build(data, num);
+    }
+
+    bool insert(uint64_t key, int class_id)
+    {
+        kvs.push_back(make_pair(key, uint32_t(class_id)));
+        if (swapped.load(memory_order_acquire)) {
+            return large->insert(key, class_id);
+        }
+
+        bool ret = small->insert(key, class_id);
+        insert_num += 1;
+        insert_failed_num += !ret;
+
+        if (building) {
+            double_written.push_back(make_pair(key, uint32_t(class_id)));
+            poll();
+        } else if (insert_num >= retry_insert_num && policy_crossed()) {
+            start_growth();
+        }
+        return ret;
+    }
+
+    // swap in the larger embedder if its build has finished
+    void poll()
+    {
+        if (building && build_done.load(memory_order_acquire)) {
+            finish_growth();
+        }
+    }
+
+    // block until a running growth is finished and swapped in
+    void wait_for_growth()
+    {
+        if (building) {
+            finish_growth();
+        }
+    }
+
+    uint32_t query(uint64_t key) const
+    {
+        if (swapped.load(memory_order_acquire)) {
+            return large->query(key);
+        }
+        // the swap happened since the check if the small embedder is gone
+        shared_ptr<const Small> s = atomic_load(&small);
+        return s ? s->query(key) : large->query(key);
+    }
+
+    bool grown() const
+    {
+        return swapped.load(memory_order_acquire);
+    }
+
+    // a larger embedder is being built and not swapped in yet
+    bool growing() const
+    {
+        return building;
+    }
+
+    // the last growth failed to build and no later one has been swapped in; the next is retried
+    // with new seeds after policy.min_inserts more inserts
+    bool growth_failed() const
+    {
+        return growth_failed_num > 0 && !building && !grown();
+    }
+
+    int growth_failures() const
+    {
+        return growth_failed_num;
+    }
+
+    int overflow_size() const
+    {
+        return grown() ? large->OverFlowTable.size() : small->OverFlowTable.size();
+    }
+
+    // the embedders in use and the retained keys, not the one a running growth is still building;
+    // call from the inserting thread
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.build_bytes = sizeof(*this);
+        if (small) {
+            m += small->memory_usage();
+        }
+        if (large) {
+            m += large->memory_usage();
+        }
+        add_vector_usage(m, &MemoryUsage::build_bytes, kvs);
+        add_vector_usage(m, &MemoryUsage::build_bytes, double_written);
+        return m;
+    }
+
+    void report()
+    {
+        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
+            "report growing coloring result...\n");
+        printf("\tbucket num is %u\n"
+               "\tkey num is %d\n"
+               "\tinsert num is %d, failed %d\n"
+               "\tfailed growths %d\n"
+               "\tThe size of overflow table is %d\n", grown() ? grown_bucket_num : bucket_num,
+               int(kvs.size()), insert_num, insert_failed_num, growth_failed_num, overflow_size());
+        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    }
+
+    ~GrowingColoringClassifier()
+    {
+        if (builder.joinable()) {
+            builder.join();
+        }
+        delete built;
+        delete large;
+    }
+};
+
+#endif //COLORINGCLASSIFER_GROWING_COLORING_CLASSIFIER_H
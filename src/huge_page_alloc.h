@@ -0,0 +1,154 @@
+#ifndef COLORINGCLASSIFER_HUGE_PAGE_ALLOC_H
+#define COLORINGCLASSIFER_HUGE_PAGE_ALLOC_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+
+using namespace std;
+
+// Storage for the large arrays (bucket colors, Bloom filter words, the overflow table, the
+// union-find nodes of the build). A query is a random access over the whole array, so with
+// 4 KB pages nearly every one also misses the TLB; 2 MB pages cut the page walks to ~1/512.
+//
+// Blocks of huge_page_size bytes and more are mapped 2 MB-aligned and rounded up to whole
+// 2 MB pages. With huge pages on, a block first tries the hugetlbfs pool (MAP_HUGETLB), then
+// falls back to an anonymous mapping with MADV_HUGEPAGE for transparent huge pages; if THP is
+// missing as well the madvise fails and the block just stays on 4 KB pages. With huge pages
+// off, the mapping gets MADV_NOHUGEPAGE, so that the two settings can be compared even where
+// THP is "always". Smaller blocks come from aligned_alloc.
+// Whether a block is mapped only depends on its size, so huge_free needs the size back, and
+// set_huge_pages may be switched at any time without confusing blocks allocated before.
+// Every block is zeroed and 64-byte aligned.
+
+constexpr size_t huge_page_size = 1 << 21;
+
+inline atomic<bool> & huge_pages_flag()
+{
+    static atomic<bool> flag(true);
+    return flag;
+}
+
+// applies to the blocks allocated from now on
+inline void set_huge_pages(bool on)
+{
+    huge_pages_flag().store(on, memory_order_relaxed);
+}
+
+inline bool huge_pages_enabled()
+{
+    return huge_pages_flag().load(memory_order_relaxed);
+}
+
+inline size_t huge_round(size_t bytes)
+{
+    return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+inline void * huge_alloc(size_t bytes)
+{
+    if (bytes < huge_page_size) {
+        size_t rounded = bytes ? (bytes + 63) / 64 * 64 : 64;
+        void * p = aligned_alloc(64, rounded);
+        if (!p) {
+            throw bad_alloc();
+        }
+        memset(p, 0, rounded);
+        return p;
+    }
+
+    size_t len = huge_round(bytes);
+    bool huge = huge_pages_enabled();
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    if (huge) {
+        // 2 MB pages explicitly, the default hugetlb size may be 1 GB
+        void * p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+    }
+#endif
+
+    // over-map by one huge page and trim both ends down to a 2 MB-aligned block
+    char * raw = (char *)mmap(NULL, len + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw bad_alloc();
+    }
+    char * p = (char *)(((uintptr_t)raw + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1));
+    if (p != raw) {
+        munmap(raw, p - raw);
+    }
+    if (p + len != raw + len + huge_page_size) {
+        munmap(p + len, raw + len + huge_page_size - (p + len));
+    }
+
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+    madvise(p, len, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+    return p;
+}
+
+inline void huge_free(void * p, size_t bytes)
+{
+    if (!p) {
+        return;
+    }
+    if (bytes < huge_page_size) {
+        free(p);
+    } else {
+        munmap(p, huge_round(bytes));
+    }
+}
+
+// operator new / delete for classes that keep their arrays in the object
+#define HUGE_PAGE_NEW \
+    static void * operator new(size_t bytes) { return huge_alloc(bytes); } \
+    static void operator delete(void * p, size_t bytes) { huge_free(p, bytes); }
+
+// std allocator for the containers that grow large (the overflow table): the big blocks
+// (bucket arrays) come from huge_alloc, the small ones (nodes) from the default allocator
+template<typename T>
+struct HugePageAllocator
+{
+    typedef T value_type;
+
+    HugePageAllocator() = default;
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U> &) {}
+
+    T * allocate(size_t n)
+    {
+        if (n * sizeof(T) < huge_page_size) {
+            return allocator<T>().allocate(n);
+        }
+        return (T *)huge_alloc(n * sizeof(T));
+    }
+
+    void deallocate(T * p, size_t n)
+    {
+        if (n * sizeof(T) < huge_page_size) {
+            allocator<T>().deallocate(p, n);
+        } else {
+            huge_free(p, n * sizeof(T));
+        }
+    }
+
+    template<typename U>
+    bool operator==(const HugePageAllocator<U> &) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const HugePageAllocator<U> &) const
+    {
+        return false;
+    }
+};
+
+#endif //COLORINGCLASSIFER_HUGE_PAGE_ALLOC_H
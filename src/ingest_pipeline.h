@@ -0,0 +1,410 @@
+#ifndef COLORINGCLASSIFER_INGEST_PIPELINE_H
+#define COLORINGCLASSIFER_INGEST_PIPELINE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <type_traits>
+#include "insert_stats.h"
+
+using namespace std;
+
+// Bounded multi-producer single-consumer ring (Vyukov): a producer claims a position with a CAS
+// on tail and publishes the slot by storing position + 1 in its sequence; the consumer takes the
+// slots in position order and frees each one by storing position + capacity. No locks, and a
+// full ring is a failed try_push, not a wait.
+template<typename T>
+class MpscRing
+{
+    struct Slot
+    {
+        atomic<uint64_t> seq;
+        T val;
+    };
+
+    unique_ptr<Slot[]> slots;
+    uint64_t mask;
+    alignas(64) atomic<uint64_t> tail;
+    // consumer side, atomic only so flush tickets can be checked from other threads
+    alignas(64) atomic<uint64_t> head;
+
+public:
+    // capacity is rounded up to a power of two
+    explicit MpscRing(size_t capacity) : tail(0), head(0)
+    {
+        uint64_t cap = 2;
+        while (cap < capacity) {
+            cap *= 2;
+        }
+        slots.reset(new Slot[cap]);
+        mask = cap - 1;
+        for (uint64_t i = 0; i < cap; ++i) {
+            slots[i].seq.store(i, memory_order_relaxed);
+        }
+    }
+
+    bool try_push(const T & val)
+    {
+        uint64_t pos = tail.load(memory_order_relaxed);
+        Slot * slot;
+        while (true) {
+            slot = &slots[pos & mask];
+            int64_t diff = int64_t(slot->seq.load(memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+        slot->val = val;
+        slot->seq.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    // consumer only: up to max_num published records in order, stops at the first unpublished one
+    size_t pop_batch(T * out, size_t max_num)
+    {
+        uint64_t pos = head.load(memory_order_relaxed);
+        size_t n = 0;
+        while (n < max_num) {
+            Slot & slot = slots[pos & mask];
+            if (slot.seq.load(memory_order_acquire) != pos + 1) {
+                break;
+            }
+            out[n++] = slot.val;
+            slot.seq.store(pos + mask + 1, memory_order_release);
+            pos++;
+        }
+        head.store(pos, memory_order_relaxed);
+        return n;
+    }
+
+    // positions claimed by producers so far, published or not
+    uint64_t claimed() const
+    {
+        return tail.load(memory_order_acquire);
+    }
+
+    uint64_t consumed() const
+    {
+        return head.load(memory_order_relaxed);
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+};
+
+// a number per thread, given out once from a process-wide counter
+inline uint32_t ingest_producer_id()
+{
+    static atomic<uint32_t> next_id(0);
+    thread_local uint32_t id = next_id.fetch_add(1, memory_order_relaxed);
+    return id;
+}
+
+// what the writer of an IngestPipeline has done; visibility is from push() to the end of the
+// batch that applied the record, when queries and flush tickets see it
+struct IngestStats
+{
+    uint64_t records;
+    uint64_t batches;
+    uint64_t failed_inserts;    // insert() returned false, for the engines that report it
+    uint64_t full_waits;        // push() calls that found their ring full at least once
+    LogLinearHistogram batch_size;
+    LogLinearHistogram visibility_ns;
+    LogLinearHistogram apply_ns;    // time to apply a batch, breaks for queries included
+
+    IngestStats() : records(0), batches(0), failed_inserts(0), full_waits(0) {}
+
+    void dump(FILE * f = stdout) const
+    {
+        fprintf(f, "ingested %lu records in %lu batches, %lu failed inserts, %lu pushes waited on a full ring\n",
+                (unsigned long)records, (unsigned long)batches, (unsigned long)failed_inserts,
+                (unsigned long)full_waits);
+        batch_size.dump(f, "batch size", "records");
+        apply_ns.dump(f, "batch apply", "ns");
+        visibility_ns.dump(f, "visibility", "ns");
+    }
+};
+
+// Ingest front end of an engine whose insert() is single-threaded: any number of producer threads
+// push (key, class) records into lock-free MPSC rings, and one writer thread drains them in
+// batches of up to batch_size into engine.insert(), holding a shared_mutex exclusively while it inserts.
+// query() takes it shared, so queries run in parallel with each other (the engine's query is const)
+// and wait only for the writer, which gives it up every max_lock_us within a batch: a query waits
+// for about that long, or one insert where a single insert takes longer.
+// Batches amortize the draining, the wakeups and the publishing of what is visible.
+// Producers are spread over the rings by a producer id given to each thread once, the same ring in
+// every pipeline, so the records of one producer are applied in push order. push() waits while the ring is full (backpressure), try_push() does not.
+// ticket() / wait() are the fence: once wait(ticket()) returns, every record pushed before
+// ticket() was called, by any thread, is applied and visible to query(). flush() is both.
+// The engine must outlive the pipeline and must not be used directly while the pipeline runs.
+template<typename Engine, typename Key = uint64_t>
+class IngestPipeline
+{
+    struct Record
+    {
+        Key key;
+        uint32_t class_id;
+        uint64_t enqueue_ns;
+    };
+
+    Engine & engine;
+    vector<unique_ptr<MpscRing<Record>>> rings;
+    size_t batch_size;
+    uint64_t max_lock_ns;
+    // records of ring r the writer has applied, published after each batch
+    unique_ptr<atomic<uint64_t>[]> applied;
+    mutable shared_mutex engine_lock;
+
+    // the writer sleeps on work_cv when all rings are empty, producers wake it only if it does
+    mutex wait_lock;
+    condition_variable work_cv, applied_cv;
+    atomic<bool> writer_sleeping, stopping;
+    atomic<int> waiters;
+    atomic<uint64_t> full_waits;
+    IngestStats writer_stats;
+    thread writer;
+
+    // depends on the thread only, so a producer pushing to several pipelines keeps one ring in each
+    MpscRing<Record> & ring_of_thread()
+    {
+        return *rings[ingest_producer_id() % rings.size()];
+    }
+
+    void wake_writer()
+    {
+        if (writer_sleeping.load(memory_order_relaxed)) {
+            lock_guard<mutex> lock(wait_lock);
+            work_cv.notify_one();
+        }
+    }
+
+    bool insert_one(const Record & r)
+    {
+        if constexpr (is_same<decltype(engine.insert(r.key, int(r.class_id))), void>::value) {
+            engine.insert(r.key, int(r.class_id));
+            return true;
+        } else {
+            return bool(engine.insert(r.key, int(r.class_id)));
+        }
+    }
+
+    void run_writer()
+    {
+        vector<Record> batch(batch_size);
+        vector<uint64_t> taken(rings.size());
+        size_t first = 0;
+        while (true) {
+            // a share of the batch from every ring, starting at another ring each time
+            size_t n = 0;
+            for (size_t i = 0; i < rings.size(); ++i) {
+                size_t r = (first + i) % rings.size();
+                size_t share = (batch_size - n) / (rings.size() - i);
+                taken[r] = share ? rings[r]->pop_batch(batch.data() + n, share) : 0;
+                n += taken[r];
+            }
+            first = (first + 1) % rings.size();
+
+            if (n == 0) {
+                if (stopping.load(memory_order_acquire) && all_consumed()) {
+                    break;
+                }
+                unique_lock<mutex> lock(wait_lock);
+                writer_sleeping.store(true);
+                // a push that saw the flag still clear is seen here; the timeout is the backstop
+                if (all_consumed() && !stopping.load()) {
+                    work_cv.wait_for(lock, chrono::milliseconds(1));
+                }
+                writer_sleeping.store(false, memory_order_relaxed);
+                continue;
+            }
+
+            uint64_t failed = 0;
+            uint64_t t0 = stats_now_ns();
+            {
+                unique_lock<shared_mutex> lock(engine_lock);
+                uint64_t locked_ns = t0;
+                for (size_t i = 0; i < n; ++i) {
+                    failed += !insert_one(batch[i]);
+                    uint64_t now = stats_now_ns();
+                    if (now - locked_ns > max_lock_ns && i + 1 < n) {
+                        // let waiting queries in, they see part of the batch
+                        lock.unlock();
+                        lock.lock();
+                        locked_ns = stats_now_ns();
+                    }
+                }
+            }
+            uint64_t t1 = stats_now_ns();
+            for (size_t r = 0; r < rings.size(); ++r) {
+                applied[r].fetch_add(taken[r], memory_order_release);
+            }
+            if (waiters.load()) {
+                lock_guard<mutex> lock(wait_lock);
+                applied_cv.notify_all();
+            }
+
+            writer_stats.records += n;
+            writer_stats.batches++;
+            writer_stats.failed_inserts += failed;
+            writer_stats.batch_size.record(n);
+            writer_stats.apply_ns.record(t1 - t0);
+            for (size_t i = 0; i < n; ++i) {
+                writer_stats.visibility_ns.record(t1 - batch[i].enqueue_ns);
+            }
+        }
+    }
+
+    bool all_consumed() const
+    {
+        for (auto & ring: rings) {
+            if (ring->consumed() != ring->claimed()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    typedef vector<uint64_t> FlushTicket;
+
+    IngestPipeline(Engine & _engine, int ring_num = 4, size_t ring_capacity = 1 << 16, size_t _batch_size = 4096,
+                   uint64_t max_lock_us = 100)
+            : engine(_engine), batch_size(max<size_t>(_batch_size, 1)), max_lock_ns(max_lock_us * 1000),
+              writer_sleeping(false), stopping(false), waiters(0), full_waits(0)
+    {
+        ring_num = max(ring_num, 1);
+        for (int r = 0; r < ring_num; ++r) {
+            rings.emplace_back(new MpscRing<Record>(ring_capacity));
+        }
+        applied.reset(new atomic<uint64_t>[ring_num]);
+        for (int r = 0; r < ring_num; ++r) {
+            applied[r].store(0);
+        }
+        writer = thread([this] { run_writer(); });
+    }
+
+    IngestPipeline(const IngestPipeline &) = delete;
+    IngestPipeline & operator=(const IngestPipeline &) = delete;
+
+    ~IngestPipeline()
+    {
+        stop();
+    }
+
+    bool try_push(const Key & key, int class_id)
+    {
+        if (!ring_of_thread().try_push(Record{key, uint32_t(class_id), stats_now_ns()})) {
+            return false;
+        }
+        wake_writer();
+        return true;
+    }
+
+    // waits while the ring is full: yields first, then sleeps, so a stalled writer costs no cpu
+    void push(const Key & key, int class_id)
+    {
+        MpscRing<Record> & ring = ring_of_thread();
+        Record rec{key, uint32_t(class_id), stats_now_ns()};
+        if (!ring.try_push(rec)) {
+            full_waits.fetch_add(1, memory_order_relaxed);
+            for (int spin = 0; !ring.try_push(rec); ++spin) {
+                wake_writer();
+                if (spin < 64) {
+                    this_thread::yield();
+                } else {
+                    this_thread::sleep_for(chrono::microseconds(50));
+                }
+            }
+        }
+        wake_writer();
+    }
+
+    // everything pushed so far, by any thread
+    FlushTicket ticket() const
+    {
+        FlushTicket t(rings.size());
+        for (size_t r = 0; r < rings.size(); ++r) {
+            t[r] = rings[r]->claimed();
+        }
+        return t;
+    }
+
+    bool visible(const FlushTicket & t) const
+    {
+        for (size_t r = 0; r < rings.size(); ++r) {
+            if (applied[r].load(memory_order_acquire) < t[r]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void wait(const FlushTicket & t)
+    {
+        if (visible(t)) {
+            return;
+        }
+        waiters.fetch_add(1);
+        unique_lock<mutex> lock(wait_lock);
+        work_cv.notify_one();
+        while (!visible(t)) {
+            applied_cv.wait_for(lock, chrono::milliseconds(1));
+        }
+        lock.unlock();
+        waiters.fetch_sub(1);
+    }
+
+    void flush()
+    {
+        wait(ticket());
+    }
+
+    auto query(const Key & key) const
+    {
+        shared_lock<shared_mutex> lock(engine_lock);
+        return engine.query(key);
+    }
+
+    // applies what is pushed and joins the writer; no push() after this
+    void stop()
+    {
+        if (!writer.joinable()) {
+            return;
+        }
+        stopping.store(true, memory_order_release);
+        {
+            lock_guard<mutex> lock(wait_lock);
+            work_cv.notify_one();
+        }
+        writer.join();
+    }
+
+    // the writer's counters, consistent once stop() returned
+    IngestStats stats() const
+    {
+        IngestStats s = writer_stats;
+        s.full_waits = full_waits.load();
+        return s;
+    }
+
+    size_t ring_num() const
+    {
+        return rings.size();
+    }
+};
+
+#endif //COLORINGCLASSIFER_INGEST_PIPELINE_H
@@ -0,0 +1,193 @@
+#ifndef COLORINGCLASSIFER_INSERT_STATS_H
+#define COLORINGCLASSIFER_INSERT_STATS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+
+using namespace std;
+
+// Histogram of uint64 values with log-linear buckets, as in HdrHistogram: values below
+// 2^sub_bits are exact, above that every power of two is split into 2^sub_bits buckets,
+// so any value is off by at most 1 / 2^sub_bits (12.5%) and recording is a clz and an add.
+class LogLinearHistogram
+{
+    static constexpr int sub_bits = 3;
+    static constexpr int sub_num = 1 << sub_bits;
+    static constexpr int bucket_num = (64 - sub_bits + 1) * sub_num;
+
+    uint64_t counts[bucket_num];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max_val;
+
+    static inline int index_of(uint64_t v)
+    {
+        if (v < sub_num) {
+            return int(v);
+        }
+        int exp = 63 - __builtin_clzll(v);
+        int sub = int(v >> (exp - sub_bits)) & (sub_num - 1);
+        return (exp - sub_bits + 1) * sub_num + sub;
+    }
+
+    // the smallest value of bucket i
+    static inline uint64_t value_of(int i)
+    {
+        if (i < sub_num) {
+            return uint64_t(i);
+        }
+        int exp = i / sub_num + sub_bits - 1;
+        return (uint64_t(sub_num + i % sub_num)) << (exp - sub_bits);
+    }
+
+public:
+    LogLinearHistogram()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(counts, 0, sizeof(counts));
+        total = sum = max_val = 0;
+    }
+
+    inline void record(uint64_t v)
+    {
+        counts[index_of(v)]++;
+        total++;
+        sum += v;
+        max_val = v > max_val ? v : max_val;
+    }
+
+    uint64_t count() const
+    {
+        return total;
+    }
+
+    uint64_t max() const
+    {
+        return max_val;
+    }
+
+    double mean() const
+    {
+        return total ? double(sum) / total : 0;
+    }
+
+    // lower bound of the bucket holding the p-th percentile, p in [0, 100]
+    uint64_t percentile(double p) const
+    {
+        if (!total) {
+            return 0;
+        }
+        uint64_t rank = uint64_t(p / 100 * (total - 1));
+        uint64_t seen = 0;
+        for (int i = 0; i < bucket_num; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                return value_of(i);
+            }
+        }
+        return max_val;
+    }
+
+    void dump(FILE * f, const char * label, const char * unit) const
+    {
+        fprintf(f, "%-22s n=%-10lu mean=%-10.1f p50=%-8lu p90=%-8lu p99=%-8lu p99.9=%-8lu max=%lu %s\n", label,
+                (unsigned long)total, mean(), (unsigned long)percentile(50), (unsigned long)percentile(90),
+                (unsigned long)percentile(99), (unsigned long)percentile(99.9), (unsigned long)max_val, unit);
+    }
+};
+
+// what an incremental insert into the coloring embedder ended with
+enum InsertOutcome
+{
+    INSERT_NOOP,          // colors already fit: pos edge across colors, neg edge inside a group
+    INSERT_MERGE,         // neg edge between two groups of the same color, merged without recoloring
+    INSERT_RECOLOR_OK,    // needed a recoloring BFS (try_color_two_bucket) that succeeded
+    INSERT_RECOLOR_FAIL,  // the recoloring failed, the key went to the overflow table
+    INSERT_OVERFLOW,      // edge collision, straight to the overflow table
+    INSERT_OUTCOME_NUM
+};
+
+static const char * const insert_outcome_names[INSERT_OUTCOME_NUM] = {
+    "noop", "merge", "recolor_ok", "recolor_fail", "overflow"
+};
+
+// Counters and histograms of ColoringClassifier::insert, always on: the cost is two clock reads
+// and a few adds per insert, against microseconds for the insert itself.
+// bfs_turns and region_size are only recorded for the inserts that ran a recoloring BFS;
+// region_size is the number of buckets the BFS took into the recolored region.
+struct InsertStats
+{
+    uint64_t outcomes[INSERT_OUTCOME_NUM];
+    LogLinearHistogram latency[INSERT_OUTCOME_NUM];   // ns
+    LogLinearHistogram bfs_turns;
+    LogLinearHistogram region_size;
+
+    InsertStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(outcomes, 0, sizeof(outcomes));
+        for (auto & h: latency) {
+            h.clear();
+        }
+        bfs_turns.clear();
+        region_size.clear();
+    }
+
+    uint64_t total() const
+    {
+        uint64_t n = 0;
+        for (uint64_t c: outcomes) {
+            n += c;
+        }
+        return n;
+    }
+
+    inline void record(InsertOutcome outcome, uint64_t ns)
+    {
+        outcomes[outcome]++;
+        latency[outcome].record(ns);
+    }
+
+    inline void record_recolor(uint64_t turns, uint64_t buckets)
+    {
+        bfs_turns.record(turns);
+        region_size.record(buckets);
+    }
+
+    void dump(FILE * f = stdout) const
+    {
+        uint64_t n = total();
+        fprintf(f, "inserts: %lu\n", (unsigned long)n);
+        for (int i = 0; i < INSERT_OUTCOME_NUM; ++i) {
+            fprintf(f, "  %-13s %10lu (%.4f%%)\n", insert_outcome_names[i], (unsigned long)outcomes[i],
+                    n ? 100.0 * outcomes[i] / n : 0.0);
+        }
+        char label[64];
+        for (int i = 0; i < INSERT_OUTCOME_NUM; ++i) {
+            if (outcomes[i]) {
+                snprintf(label, sizeof(label), "latency %s", insert_outcome_names[i]);
+                latency[i].dump(f, label, "ns");
+            }
+        }
+        bfs_turns.dump(f, "bfs turns", "");
+        region_size.dump(f, "recolor region", "buckets");
+    }
+};
+
+// steady clock in ns for the insert latencies
+inline uint64_t stats_now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif //COLORINGCLASSIFER_INSERT_STATS_H
@@ -0,0 +1,77 @@
+#ifndef COLORINGCLASSIFER_KEY_TYPES_H
+#define COLORINGCLASSIFER_KEY_TYPES_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include "BOB_hash.h"
+
+// Fixed-width keys accepted by the classifiers and filters besides uint64_t.
+// Any trivially copyable type without padding works, every one of its bytes is hashed.
+
+// e.g. an IPv6 address
+struct Key128
+{
+    uint64_t lo, hi;
+};
+
+#pragma pack(push, 1)
+// IPv4 flow 5-tuple, 13 bytes
+struct FlowKey
+{
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t proto;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Key128) == 16, "Key128 must not be padded");
+static_assert(sizeof(FlowKey) == 13, "FlowKey must not be padded");
+
+inline bool operator==(const Key128 & a, const Key128 & b)
+{
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+inline bool operator==(const FlowKey & a, const FlowKey & b)
+{
+    return memcmp(&a, &b, sizeof(FlowKey)) == 0;
+}
+
+// order used by the sorted overflow section of query images
+template<typename Key>
+inline bool key_less(const Key & a, const Key & b)
+{
+    return memcmp(&a, &b, sizeof(Key)) < 0;
+}
+
+template<>
+inline bool key_less<uint64_t>(const uint64_t & a, const uint64_t & b)
+{
+    return a < b;
+}
+
+namespace std {
+template<>
+struct hash<Key128>
+{
+    size_t operator()(const Key128 & k) const
+    {
+        return BOB_fixed<sizeof(Key128)>(&k, 0x2f0329f4);
+    }
+};
+
+template<>
+struct hash<FlowKey>
+{
+    size_t operator()(const FlowKey & k) const
+    {
+        return BOB_fixed<sizeof(FlowKey)>(&k, 0x2f0329f4);
+    }
+};
+}
+
+#endif //COLORINGCLASSIFER_KEY_TYPES_H
@@ -6,7 +6,17 @@
 #include "coded_bloom_filter.h"
 #include "multi_bloom_filter.h"
 #include "shifting_bloom_filter.h"
+#include "dynamic_bloom_filter.h"
+#include "xor_retrieval.h"
+#include "sharded_coloring_classifier.h"
+#include "mapped_coloring_classifier.h"
+#include "growing_coloring_classifier.h"
+#include "workload.h"
+#include "ingest_pipeline.h"
 #include<chrono>
+#include <thread>
+#include <atomic>
+#include <malloc.h>
 
 #define MAXN 10000
 #define insertN 1000
@@ -20,29 +30,12 @@ int err_0_cnt = 0;
 
 void test_two_set()
 {
-    // generate 10k data randomly
-    vector<pair<uint64_t, uint32_t>> data(MAXN + insertN);
-
-    // std::random_device rd;
-    // std::mt19937 gen(rd());
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    mt19937 gen(seed);	 // 大随机数
-    std::uniform_int_distribution<uint64_t> dis(0, 1ull << 40);
-
-    unordered_set<uint64_t> filter;
-
-    for (int i = 0; i < MAXN; ++i) {
-        uint64_t item;
-        while (1) {
-            item = dis(gen);
-            if (filter.find(item) == filter.end()) {
-                filter.insert(item);
-                break;
-            }
-        }
-        data[i].first = item;
-        data[i].second = (i % 2 == 0);
-    }
+    // generate 10k data randomly, every run with the next seed so a series of runs is reproducible
+    static uint64_t run = 0;
+    WorkloadSpec spec;
+    spec.seed = ++run;
+    spec.key_bits = 40;
+    KVList data = WorkloadGenerator(spec).kvs(MAXN + insertN);
 
     auto cc = new ShiftingColoringClassifier<int(MAXN * 1.11), 4, 2>();
 
@@ -73,16 +66,6 @@ void test_two_set()
     // test for insert
     for(int i = MAXN; i < MAXN + insertN; i++){
         // cout <<"Insert " << i - MAXN + 1 << endl;
-        uint64_t item;
-        while (1) {
-            item = dis(gen);
-            if (filter.find(item) == filter.end()) {
-                filter.insert(item);
-                break;
-            }
-        }
-        data[i].first = item;
-        data[i].second = (i % 2 == 0);
         bool flag = cc -> insert(data[i].first, data[i].second);
         if(!flag){
             // cout << "Insert Failed" <<endl;
@@ -120,10 +103,1569 @@ void test_two_set()
     delete cc;
     cc = NULL;
     data.clear();
-    filter.clear();
 }
 
-int main()
+// build one classifier per thread, each with its own seeds and data,
+// then validate every instance once all of them are done
+bool test_concurrent_build()
+{
+    const int thread_num = 32;
+    typedef ShiftingColoringClassifier<int(MAXN * 1.11), 4, 2> CC;
+
+    vector<CC *> ccs(thread_num, NULL);
+    vector<KVList> datas(thread_num);
+    vector<int> build_results(thread_num);
+    vector<thread> threads;
+
+    for (int t = 0; t < thread_num; ++t) {
+        threads.push_back(thread([&, t] {
+            mt19937 gen(t + 1);
+            WorkloadSpec spec;
+            spec.seed = t + 1;
+            spec.key_bits = 40;
+            KVList & data = datas[t];
+            WorkloadGenerator(spec).append(data, 0, MAXN);
+
+            // a failed build is retried with fresh seeds on a new instance
+            for (int retry = 0; retry < 5 && !build_results[t]; ++retry) {
+                delete ccs[t];
+                ccs[t] = new CC(uint32_t(gen()), uint32_t(gen()));
+                build_results[t] = ccs[t]->build(data, MAXN);
+            }
+        }));
+    }
+    for (auto & th: threads) {
+        th.join();
+    }
+
+    int failed = 0;
+    for (int t = 0; t < thread_num; ++t) {
+        int err_cnt = 0;
+        for (int i = 0; i < MAXN; ++i) {
+            err_cnt += (ccs[t]->query(datas[t][i].first) != datas[t][i].second);
+        }
+        if (!build_results[t] || err_cnt != 0) {
+            failed++;
+        }
+        cout << "Instance " << t << ": build " << (build_results[t] ? "success" : "failed")
+             << ", error count " << err_cnt << endl;
+        delete ccs[t];
+    }
+
+    cout << thread_num - failed << "/" << thread_num << " instances valid" << endl;
+    return failed == 0;
+}
+
+// compare one big embedder with 16 shards using the same total number of buckets
+bool test_sharded()
+{
+    const int num = 200000;
+    const uint32_t shard_num = 16, shard_bucket_num = 16384;
+    typedef ShardedColoringClassifier<shard_bucket_num, shard_num, 4, 2> Sharded;
+    typedef ShiftingColoringClassifier<shard_bucket_num * shard_num, 4, 2> Single;
+
+    WorkloadSpec spec;
+    spec.seed = 1;
+    spec.key_bits = 40;
+    KVList data = WorkloadGenerator(spec).kvs(num);
+
+    auto t0 = chrono::steady_clock::now();
+    auto single = new Single(1, 2);
+    bool single_result = single->build(data, num);
+    auto t1 = chrono::steady_clock::now();
+    auto sharded = new Sharded(1);
+    // a query before any build must not touch the missing shards
+    sharded->query(data[0].first);
+    bool sharded_result = sharded->build(data, num);
+    auto t2 = chrono::steady_clock::now();
+    bool rebuild_result = sharded->rebuild_shard(0);
+    auto t3 = chrono::steady_clock::now();
+    // building again replaces the keys instead of adding a second copy of them
+    bool second_result = sharded->build(data, num);
+
+    int single_err = 0, sharded_err = 0;
+    for (int i = 0; i < num; ++i) {
+        single_err += (single->query(data[i].first) != data[i].second);
+        sharded_err += (sharded->query(data[i].first) != data[i].second);
+    }
+
+    sharded->report();
+    auto ms = [](chrono::steady_clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+    cout << "Single embedder: build " << (single_result ? "success" : "failed") << " in " << ms(t1 - t0)
+         << " ms, error count " << single_err << endl;
+    cout << "Sharded embedder (" << shard_num << " shards, " << sharded->thread_num << " threads): build "
+         << (sharded_result ? "success" : "failed") << " in " << ms(t2 - t1) << " ms, error count " << sharded_err << endl;
+    cout << "Rebuild of a single shard: " << (rebuild_result ? "success" : "failed") << " in " << ms(t3 - t2) << " ms" << endl;
+    cout << "Second build on the same keys: " << (second_result ? "success" : "failed") << endl;
+
+    delete single;
+    delete sharded;
+    return sharded_result && rebuild_result && second_result && sharded_err == 0;
+}
+
+// restore a classifier from a snapshot and compare with building it again
+bool test_snapshot(const char * path)
+{
+    const int num = 200000, insert_num = 1000;
+    typedef ShiftingColoringClassifier<int(num * 1.25), 4, 2> CC;
+
+    WorkloadSpec spec;
+    spec.seed = 2;
+    spec.key_bits = 40;
+    KVList data = WorkloadGenerator(spec).kvs(num + insert_num);
+
+    auto t0 = chrono::steady_clock::now();
+    auto cc = new CC(3, 4);
+    bool build_result = cc->build(data, num);
+    auto t1 = chrono::steady_clock::now();
+    bool save_result = build_result && cc->save(path);
+    auto t2 = chrono::steady_clock::now();
+    auto restored = new CC();
+    bool load_result = save_result && restored->load(path);
+    auto t3 = chrono::steady_clock::now();
+
+    int diff_cnt = 0;
+    for (int i = 0; i < num + insert_num; ++i) {
+        diff_cnt += (cc->query(data[i].first) != restored->query(data[i].first));
+    }
+
+    // the restored instance must keep accepting inserts
+    for (int i = num; i < num + insert_num; ++i) {
+        restored->insert(data[i].first, data[i].second);
+    }
+    int err_cnt = 0;
+    for (int i = 0; i < num + insert_num; ++i) {
+        err_cnt += (restored->query(data[i].first) != data[i].second);
+    }
+
+    auto ms = [](chrono::steady_clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+    cout << "Build: " << (build_result ? "success" : "failed") << " in " << ms(t1 - t0) << " ms" << endl;
+    cout << "Save: " << (save_result ? "success" : "failed") << " in " << ms(t2 - t1) << " ms" << endl;
+    cout << "Load: " << (load_result ? "success" : "failed") << " in " << ms(t3 - t2) << " ms" << endl;
+    cout << "Queries differing after load: " << diff_cnt << endl;
+    cout << "Error count after " << insert_num << " inserts into the restored classifier: " << err_cnt << endl;
+
+    delete cc;
+    delete restored;
+    remove(path);
+    return load_result && diff_cnt == 0 && err_cnt == 0;
+}
+
+// value of a field of /proc/self/status in kB, e.g. VmRSS or RssFile
+long read_status_kb(const char * field)
+{
+    FILE * f = fopen("/proc/self/status", "r");
+    if (!f) {
+        return -1;
+    }
+    char line[256];
+    long ret = -1;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            ret = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+// open a query image with its pages evicted and measure startup, query latency and RSS
+bool test_mapped(const char * path)
+{
+    const int num = 200000, insert_num = 1000;
+    typedef ShiftingColoringClassifier<int(num * 1.25), 4, 2> CC;
+
+    WorkloadSpec spec;
+    spec.seed = 2;
+    spec.key_bits = 40;
+    KVList data = WorkloadGenerator(spec).kvs(num + insert_num);
+
+    auto cc = new CC(3, 4);
+    bool build_result = cc->build(data, num);
+    for (int i = num; i < num + insert_num; ++i) {
+        cc->insert(data[i].first, data[i].second);
+    }
+    bool save_result = build_result && cc->save_image(path);
+
+    // drop the image from the page cache to get a cold start
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    long rss_before = read_status_kb("VmRSS"), file_before = read_status_kb("RssFile");
+    auto t0 = chrono::steady_clock::now();
+    MappedColoringClassifier<4> mapped;
+    bool open_result = save_result && mapped.open(path);
+    auto t1 = chrono::steady_clock::now();
+    uint32_t first = open_result ? mapped.query(data[0].first) : 0;
+    auto t2 = chrono::steady_clock::now();
+    long rss_open = read_status_kb("VmRSS");
+
+    int diff_cnt = 0, err_cnt = 0;
+    auto t3 = chrono::steady_clock::now();
+    for (int i = 0; i < num + insert_num && open_result; ++i) {
+        uint32_t r = mapped.query(data[i].first);
+        diff_cnt += (r != cc->query(data[i].first));
+        err_cnt += (r != data[i].second);
+    }
+    auto t4 = chrono::steady_clock::now();
+    uint32_t sum = first;
+    for (int i = 0; i < num + insert_num && open_result; ++i) {
+        sum += mapped.query(data[i].first);
+    }
+    auto t5 = chrono::steady_clock::now();
+    long rss_after = read_status_kb("VmRSS"), file_after = read_status_kb("RssFile");
+
+    auto us = [](chrono::steady_clock::duration d) { return chrono::duration<double, micro>(d).count(); };
+    cout << "Image: " << (save_result ? "saved" : "not saved") << ", " << mapped.mapped_size() << " bytes" << endl;
+    cout << "Open: " << (open_result ? "success" : "failed") << " in " << us(t1 - t0) << " us, first query "
+         << us(t2 - t1) << " us" << endl;
+    cout << "Cold pass: " << us(t4 - t3) * 1000 / (num + insert_num) / 2 << " ns/query (with reference query), warm pass: "
+         << us(t5 - t4) * 1000 / (num + insert_num) << " ns/query (checksum " << sum << ")" << endl;
+    cout << "VmRSS kB: before open " << rss_before << ", after open " << rss_open << ", after queries " << rss_after << endl;
+    cout << "RssFile kB (shared through the page cache): before " << file_before << ", after " << file_after << endl;
+    cout << "Queries differing from the classifier: " << diff_cnt << ", error count: " << err_cnt << endl;
+
+    // corrupt copies of the header must be refused by open(), not crash the queries
+    bool corrupt_refused = true;
+    if (open_result) {
+        ImageHeader good;
+        int gfd = open(path, O_RDONLY);
+        corrupt_refused = gfd >= 0 && pread(gfd, &good, sizeof(good), 0) == ssize_t(sizeof(good));
+        if (gfd >= 0) {
+            close(gfd);
+        }
+        vector<ImageHeader> corrupt(4, good);
+        corrupt[0].offset_num = 40;
+        corrupt[1].overflow_offset = good.buckets_offset;
+        corrupt[2].buckets_offset = uint64_t(0) - IMAGE_ALIGN;
+        corrupt[3].overflow_num = uint64_t(1) << 60;
+        for (auto & h: corrupt) {
+            int cfd = open(path, O_WRONLY);
+            bool written = cfd >= 0 && pwrite(cfd, &h, sizeof(h), 0) == ssize_t(sizeof(h));
+            if (cfd >= 0) {
+                close(cfd);
+            }
+            MappedColoringClassifier<4> bad;
+            corrupt_refused = corrupt_refused && written && !bad.open(path);
+        }
+        cout << "Corrupt headers: " << (corrupt_refused ? "all refused" : "NOT refused") << endl;
+    }
+
+    delete cc;
+    remove(path);
+    return open_result && diff_cnt == 0 && err_cnt == 0 && corrupt_refused;
+}
+
+// keep inserting into a classifier sized for MAXN keys and let it grow; the first growth is made
+// to fail (no seeds to try) and must be retried
+bool test_growing()
+{
+    const int grow_insert_num = 2 * MAXN;
+    typedef GrowingColoringClassifier<int(MAXN * 1.11), int(MAXN * 3.33), 4> CC;
+
+    WorkloadSpec spec;
+    spec.seed = 5;
+    spec.key_bits = 40;
+    KVList data = WorkloadGenerator(spec).kvs(MAXN + grow_insert_num);
+
+    auto cc = new CC(6);
+    bool build_result = cc->build(data, MAXN);
+    cout << "Build " << MAXN << " keys: " << (build_result ? "success" : "failed") << endl;
+
+    const int max_retry = cc->max_retry;
+    cc->max_retry = 0;
+    int failed_at = -1, regrow_at = -1;
+    int grown_at = -1;
+    int swap_reader_err = -1;
+    for (int i = MAXN; i < MAXN + grow_insert_num; ++i) {
+        cc->insert(data[i].first, data[i].second);
+        if (failed_at == -1 && cc->growth_failed()) {
+            failed_at = i - MAXN + 1;
+            cc->max_retry = max_retry;
+        }
+        if (failed_at != -1 && regrow_at == -1 && cc->growing()) {
+            regrow_at = i - MAXN + 1;
+        }
+        if (failed_at != -1 && swap_reader_err == -1 && cc->growing()) {
+            // readers keep querying the built keys while the larger embedder is swapped in under them
+            atomic<int> reader_err(0);
+            atomic<bool> swap_done(false);
+            vector<thread> readers;
+            for (int t = 0; t < 2; ++t) {
+                readers.push_back(thread([&, t] {
+                    for (int j = t, pass = 0; !swap_done || pass == 0; j = (j + 2) % MAXN) {
+                        reader_err += (cc->query(data[j].first) != data[j].second);
+                        pass += (j + 2 >= MAXN);
+                    }
+                }));
+            }
+            cc->wait_for_growth();
+            swap_done = true;
+            for (auto & th: readers) {
+                th.join();
+            }
+            swap_reader_err = reader_err;
+        }
+        if (grown_at == -1 && cc->grown()) {
+            grown_at = i - MAXN + 1;
+        }
+        if ((i - MAXN + 1) % 2000 == 0) {
+            cout << "After " << i - MAXN + 1 << " inserts: overflow table size " << cc->overflow_size()
+                 << (cc->grown() ? " (grown)" : "") << endl;
+        }
+    }
+    cc->wait_for_growth();
+    if (grown_at == -1 && cc->grown()) {
+        grown_at = grow_insert_num;
+    }
+
+    int err_cnt = 0;
+    for (int i = 0; i < MAXN + grow_insert_num; ++i) {
+        err_cnt += (cc->query(data[i].first) != data[i].second);
+    }
+    cc->report();
+    cout << "First growth failed after " << failed_at << " inserts, retried after " << regrow_at << endl;
+    cout << "Swapped in the larger embedder after " << grown_at << " inserts" << endl;
+    cout << "Errors of the queries running during the swap: " << swap_reader_err << endl;
+    cout << "Error count: " << err_cnt << endl;
+
+    bool retried = failed_at != -1 && regrow_at - failed_at >= cc->policy.min_inserts && cc->growth_failures() == 1;
+    bool ret = build_result && retried && cc->grown() && err_cnt == 0 && swap_reader_err == 0;
+    delete cc;
+    return ret;
+}
+
+// random reads from a packed color array against a plain byte per bucket
+template<int color_num>
+bool bench_color_storage(const vector<uint32_t> & idx)
+{
+    typedef ColorStorage<color_num> Storage;
+    const uint64_t n = 1 << 24;
+
+    vector<uint8_t> plain(n);
+    vector<uint8_t> packed(Storage::bytes(n));
+    mt19937 gen(color_num);
+    for (uint64_t i = 0; i < n; ++i) {
+        plain[i] = uint8_t(gen() % color_num);
+        Storage::set(packed.data(), i, plain[i]);
+    }
+    bool ok = true;
+    for (uint64_t i = 0; i < n; ++i) {
+        ok &= (Storage::get(packed.data(), i) == plain[i]);
+    }
+
+    uint64_t sum_plain = 0, sum_packed = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (uint32_t i: idx) {
+        sum_plain += plain[i];
+    }
+    auto t1 = chrono::steady_clock::now();
+    for (uint32_t i: idx) {
+        sum_packed += Storage::get(packed.data(), i);
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    auto ns = [&](chrono::steady_clock::duration d) { return chrono::duration<double, nano>(d).count() / idx.size(); };
+    printf("%3d colors: %.3f bits/bucket, packed %.2f ns/get, byte %.2f ns/get, %s\n", color_num,
+           8.0 * Storage::bytes(n) / n, ns(t2 - t1), ns(t1 - t0), (ok && sum_plain == sum_packed) ? "ok" : "MISMATCH");
+    return ok && sum_plain == sum_packed;
+}
+
+bool test_color_storage()
+{
+    vector<uint32_t> idx(1 << 24);
+    mt19937 gen(7);
+    for (auto & i: idx) {
+        i = gen() % (1 << 24);
+    }
+    bool ok = true;
+    ok &= bench_color_storage<2>(idx);
+    ok &= bench_color_storage<3>(idx);
+    ok &= bench_color_storage<4>(idx);
+    ok &= bench_color_storage<5>(idx);
+    ok &= bench_color_storage<6>(idx);
+    ok &= bench_color_storage<8>(idx);
+    ok &= bench_color_storage<12>(idx);
+    ok &= bench_color_storage<16>(idx);
+    ok &= bench_color_storage<32>(idx);
+    ok &= bench_color_storage<256>(idx);
+    return ok;
+}
+
+// URL-like string keys, some of them longer than MAX_LEN, through the string_view path
+bool test_string_keys()
+{
+    const int num = 200000, query_rounds = 5;
+    typedef ShiftingColoringClassifier<int(num * 1.25), 4, 2> CC;
+
+    mt19937 gen(8);
+    const char * tlds[] = {"com", "net", "org", "cn", "io"};
+    vector<string> keys;
+    unordered_set<string> filter;
+    while ((int)keys.size() < num) {
+        string key = "https://www." + to_string(gen() % 1000000) + "-site." + tlds[gen() % 5] + "/";
+        int depth = gen() % 4;
+        for (int d = 0; d < depth; ++d) {
+            key += "path" + to_string(gen() % 1000) + "/";
+        }
+        if (gen() % 100 == 0) {
+            key += string(MAX_LEN + gen() % 200, 'x');
+        }
+        if (filter.insert(key).second) {
+            keys.push_back(key);
+        }
+    }
+
+    StrKVList data;
+    size_t total_len = 0, long_num = 0;
+    for (int i = 0; i < num; ++i) {
+        data.push_back(make_pair(string_view(keys[i]), uint32_t(i % 2 == 0)));
+        total_len += keys[i].size();
+        long_num += keys[i].size() >= MAX_LEN;
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    auto cc = new CC(9, 10);
+    bool build_result = cc->build(data, num);
+    auto t1 = chrono::steady_clock::now();
+
+    int err_cnt = 0;
+    for (int i = 0; i < num; ++i) {
+        err_cnt += (cc->query(data[i].first) != data[i].second);
+    }
+
+    uint32_t sum = 0;
+    auto t2 = chrono::steady_clock::now();
+    for (int r = 0; r < query_rounds; ++r) {
+        for (int i = 0; i < num; ++i) {
+            sum += cc->query(data[i].first);
+        }
+    }
+    auto t3 = chrono::steady_clock::now();
+
+    auto ms = [](chrono::steady_clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+    cout << num << " string keys, average length " << double(total_len) / num << ", " << long_num
+         << " of them at least " << MAX_LEN << " bytes" << endl;
+    cout << "Build: " << (build_result ? "success" : "failed") << " in " << ms(t1 - t0) << " ms" << endl;
+    cout << "Query: " << ms(t3 - t2) * 1e6 / (double(num) * query_rounds) << " ns/query (checksum " << sum << ")" << endl;
+    cout << "Error count: " << err_cnt << endl;
+
+    delete cc;
+    return build_result && err_cnt == 0;
+}
+
+template<typename Key>
+bool bench_key_type(const char * label, const vector<Key> & keys)
+{
+    const int num = int(keys.size()), query_rounds = 5;
+    typedef ShiftingColoringClassifier<int(200000 * 1.25), 4, 2, Key> CC;
+    typedef MultiBloomFilter<200000 * 16, 8, 2, Key> BF;
+
+    KeyValueList<Key> data;
+    for (int i = 0; i < num; ++i) {
+        data.push_back(make_pair(keys[i], uint32_t(i % 2 == 0)));
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    auto cc = new CC(11, 12);
+    bool build_result = cc->build(data, num);
+    auto t1 = chrono::steady_clock::now();
+
+    int err_cnt = 0;
+    for (int i = 0; i < num; ++i) {
+        err_cnt += (cc->query(data[i].first) != data[i].second);
+    }
+
+    uint32_t sum = 0;
+    auto t2 = chrono::steady_clock::now();
+    for (int r = 0; r < query_rounds; ++r) {
+        for (int i = 0; i < num; ++i) {
+            sum += cc->query(data[i].first);
+        }
+    }
+    auto t3 = chrono::steady_clock::now();
+
+    // the image and the snapshot carry the key width and must round trip
+    MappedColoringClassifier<4, Key> mapped;
+    int image_err_cnt = -1;
+    if (cc->save_image("cc_keytypes.bin") && mapped.open("cc_keytypes.bin")) {
+        image_err_cnt = 0;
+        for (int i = 0; i < num; ++i) {
+            image_err_cnt += (mapped.query(data[i].first) != data[i].second);
+        }
+    }
+    auto loaded = new CC();
+    int snapshot_err_cnt = -1;
+    if (cc->save("cc_keytypes.bin") && loaded->load("cc_keytypes.bin")) {
+        snapshot_err_cnt = 0;
+        for (int i = 0; i < num; ++i) {
+            snapshot_err_cnt += (loaded->query(data[i].first) != data[i].second);
+        }
+    }
+    remove("cc_keytypes.bin");
+
+    auto bf = new BF();
+    bf->build(data, num);
+    auto t4 = chrono::steady_clock::now();
+    for (int r = 0; r < query_rounds; ++r) {
+        for (int i = 0; i < num; ++i) {
+            sum += bf->query(data[i].first);
+        }
+    }
+    auto t5 = chrono::steady_clock::now();
+
+    auto ns = [&](chrono::steady_clock::duration d) {
+        return chrono::duration<double, nano>(d).count() / (double(num) * query_rounds);
+    };
+    printf("%-8s %2d bytes: build %s in %.1f ms, overflow %d, errors %d/%d/%d (cc/image/snapshot), "
+           "cc %.1f ns/query, multi bf %.1f ns/query (checksum %u)\n",
+           label, int(sizeof(Key)), build_result ? "success" : "failed",
+           chrono::duration<double, milli>(t1 - t0).count(), cc->OverFlowTable.size(),
+           err_cnt, image_err_cnt, snapshot_err_cnt, ns(t3 - t2), ns(t5 - t4), sum);
+
+    delete cc;
+    delete loaded;
+    delete bf;
+    return build_result && err_cnt == 0 && image_err_cnt == 0 && snapshot_err_cnt == 0;
+}
+
+bool test_key_types()
+{
+    const int num = 200000;
+    mt19937_64 gen(13);
+
+    // keys that only differ above bit 32, which used to collapse to one hash value
+    vector<uint64_t> u64_keys;
+    unordered_set<uint32_t> low_words;
+    for (int i = 0; i < num; ++i) {
+        u64_keys.push_back((uint64_t(i + 1) << 32) | 0x0a000001);
+        low_words.insert(uint32_t(u64_keys.back()));
+    }
+
+    vector<Key128> v6_keys;
+    unordered_set<Key128> v6_filter;
+    while ((int)v6_keys.size() < num) {
+        Key128 k = {0x20010db800000000ull, gen() & 0xffffffffffull};
+        if (v6_filter.insert(k).second) {
+            v6_keys.push_back(k);
+        }
+    }
+
+    vector<FlowKey> flow_keys;
+    unordered_set<FlowKey> flow_filter;
+    while ((int)flow_keys.size() < num) {
+        FlowKey k;
+        k.src_ip = 0xc0a80000 | uint32_t(gen() & 0xffff);
+        k.dst_ip = 0x08080808;
+        k.src_port = uint16_t(gen());
+        k.dst_port = 443;
+        k.proto = 6;
+        if (flow_filter.insert(k).second) {
+            flow_keys.push_back(k);
+        }
+    }
+
+    cout << num << " keys per type, " << low_words.size() << " distinct low 32 bits among the uint64 keys" << endl;
+    bool ok = bench_key_type("uint64", u64_keys);
+    ok = bench_key_type("Key128", v6_keys) && ok;
+    ok = bench_key_type("FlowKey", flow_keys) && ok;
+    return ok;
+}
+
+// FPR of absent keys for MultiBF, error rate of member keys for 4-class CodedBF, and query latency
+template<int bits_per_key, int k, bool blocked>
+bool bench_blocked_bf(const KVList & data, const vector<uint64_t> & absent)
+{
+    const int num = int(data.size());
+    typedef MultiBloomFilter<bits_per_key * (1 << 22), k, 2, uint64_t, blocked> MBF;
+    typedef CodedBloomFilter<bits_per_key * (1 << 22), k, 4, uint64_t, blocked> CBF;
+    auto ns = [&](chrono::steady_clock::duration d) {
+        return chrono::duration<double, nano>(d).count() / num;
+    };
+
+    auto mbf = new MBF();
+    auto cbf = new CBF();
+    for (int i = 0; i < num; ++i) {
+        mbf->insert(data[i].first, data[i].second % 2);
+        cbf->insert(data[i].first, data[i].second);
+    }
+
+    int fp_cnt = 0, ambiguous_cnt = 0, coded_err_cnt = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < num; ++i) {
+        fp_cnt += (mbf->query(absent[i]) != -2);
+    }
+    auto t1 = chrono::steady_clock::now();
+    for (int i = 0; i < num; ++i) {
+        ambiguous_cnt += (mbf->query(data[i].first) == -1);
+    }
+    auto t2 = chrono::steady_clock::now();
+    for (int i = 0; i < num; ++i) {
+        coded_err_cnt += (cbf->query(data[i].first) != int(data[i].second));
+    }
+    auto t3 = chrono::steady_clock::now();
+
+    printf("%-8s %2d bits/key k=%2d: MultiBF fpr %.5f, ambiguous %.5f, absent %.1f ns, member %.1f ns | "
+           "CodedBF error %.5f, %.1f ns\n", blocked ? "blocked" : "classic", bits_per_key, k,
+           double(fp_cnt) / num, double(ambiguous_cnt) / num, ns(t1 - t0), ns(t2 - t1),
+           double(coded_err_cnt) / num, ns(t3 - t2));
+
+    delete mbf;
+    delete cbf;
+    return true;
+}
+
+bool test_blocked_bf()
+{
+    // 4M keys, so even the smallest filter (4MB) does not fit in L2
+    const int num = 1 << 22;
+    WorkloadSpec spec;
+    spec.seed = 14;
+    spec.class_num = 4;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    vector<uint64_t> absent = gen.aliens(num);
+
+    bool ok = bench_blocked_bf<8, 6, false>(data, absent);
+    ok = bench_blocked_bf<8, 6, true>(data, absent) && ok;
+    ok = bench_blocked_bf<12, 8, false>(data, absent) && ok;
+    ok = bench_blocked_bf<12, 8, true>(data, absent) && ok;
+    ok = bench_blocked_bf<16, 11, false>(data, absent) && ok;
+    ok = bench_blocked_bf<16, 11, true>(data, absent) && ok;
+    return ok;
+}
+
+// fpr of absent keys and ns per query, MultiBF returns -2 and ShiftBF -1 for an absent key
+template<typename BF>
+void bench_probe_hash(const char * label, int bits_per_key, int k, int absent_ret,
+                      const KVList & data, const vector<uint64_t> & absent)
+{
+    const int num = int(data.size());
+    auto bf = new BF();
+    for (int i = 0; i < num; ++i) {
+        bf->insert(data[i].first, data[i].second);
+    }
+
+    int fp_cnt = 0, err_cnt = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < num; ++i) {
+        fp_cnt += (bf->query(absent[i]) != absent_ret);
+    }
+    auto t1 = chrono::steady_clock::now();
+    for (int i = 0; i < num; ++i) {
+        err_cnt += (bf->query(data[i].first) != int(data[i].second));
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    auto ns = [&](chrono::steady_clock::duration d) {
+        return chrono::duration<double, nano>(d).count() / num;
+    };
+    printf("%-22s %2d bits/key k=%2d: fpr %.5f, member error %.5f, absent %.1f ns, member %.1f ns\n",
+           label, bits_per_key, k, double(fp_cnt) / num, double(err_cnt) / num, ns(t1 - t0), ns(t2 - t1));
+    delete bf;
+}
+
+template<int bits_per_key, int k>
+void bench_probe_hash_all(const KVList & data, const vector<uint64_t> & absent)
+{
+    const int num_bits = bits_per_key * (1 << 20);
+    bench_probe_hash<MultiBloomFilter<num_bits, k, 2>>("MultiBF", bits_per_key, k, -2, data, absent);
+    bench_probe_hash<MultiBloomFilter<num_bits, k, 2, uint64_t, false, true>>(
+            "MultiBF double hash", bits_per_key, k, -2, data, absent);
+    bench_probe_hash<MultiBloomFilter<num_bits, k, 2, uint64_t, true>>(
+            "BlockedMultiBF", bits_per_key, k, -2, data, absent);
+    bench_probe_hash<MultiBloomFilter<num_bits, k, 2, uint64_t, true, true>>(
+            "BlockedMultiBF dh", bits_per_key, k, -2, data, absent);
+    bench_probe_hash<ShiftingBloomFilter<num_bits, k, 2>>("ShiftBF", bits_per_key, k, -1, data, absent);
+    bench_probe_hash<ShiftingBloomFilter<num_bits, k, 2, uint64_t, true>>(
+            "ShiftBF double hash", bits_per_key, k, -1, data, absent);
+}
+
+bool test_probe_hash()
+{
+    const int num = 1 << 20;
+    WorkloadSpec spec;
+    spec.seed = 15;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    vector<uint64_t> absent = gen.aliens(num);
+
+    bench_probe_hash_all<8, 6>(data, absent);
+    bench_probe_hash_all<12, 8>(data, absent);
+    bench_probe_hash_all<16, 11>(data, absent);
+    return true;
+}
+
+// query_batch must give exactly the answers of query(), and is timed against a loop over query()
+template<typename BF>
+bool bench_query_batch(const char * label, const KVList & data, const vector<uint64_t> & probes)
+{
+    auto bf = new BF();
+    for (auto & kv: data) {
+        bf->insert(kv.first, kv.second % BF::_class_num);
+    }
+
+    const size_t num = probes.size();
+    vector<int> scalar(num), batch(num);
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < num; ++i) {
+        scalar[i] = bf->query(probes[i]);
+    }
+    auto t1 = chrono::steady_clock::now();
+    bf->query_batch(probes.data(), batch.data(), num);
+    auto t2 = chrono::steady_clock::now();
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < num; ++i) {
+        mismatch += (scalar[i] != batch[i]);
+    }
+    auto ns = [&](chrono::steady_clock::duration d) {
+        return chrono::duration<double, nano>(d).count() / num;
+    };
+    printf("%-22s scalar %.1f ns/key, batch %.1f ns/key (%.2fx), mismatches %zu\n",
+           label, ns(t1 - t0), ns(t2 - t1), ns(t1 - t0) / ns(t2 - t1), mismatch);
+    delete bf;
+    return mismatch == 0;
+}
+
+bool test_query_batch()
+{
+#ifndef __AVX2__
+    cout << "Built without AVX2, query_batch falls back to query()" << endl;
+#endif
+    // half members, half absent keys, and a length that is not a multiple of 8
+    const int num = 1 << 20;
+    const int num_bits = 12 * num;
+    WorkloadSpec spec;
+    spec.seed = 16;
+    spec.class_num = 4;
+    spec.class_dist = CLASSES_UNIFORM;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    QueryMix mix;
+    mix.hit_rate = 0.5;
+    vector<uint64_t> probes = gen.queries(2 * num - 3, num, mix);
+
+    bool ok = bench_query_batch<MultiBloomFilter<num_bits, 8, 2>>("MultiBF", data, probes);
+    ok = bench_query_batch<MultiBloomFilter<num_bits, 8, 2, uint64_t, false, true>>("MultiBF double hash", data, probes) && ok;
+    ok = bench_query_batch<MultiBloomFilter<num_bits, 8, 2, uint64_t, true>>("BlockedMultiBF", data, probes) && ok;
+    ok = bench_query_batch<CodedBloomFilter<num_bits, 8, 4>>("CodedBF", data, probes) && ok;
+    ok = bench_query_batch<CodedBloomFilter<num_bits, 8, 4, uint64_t, false, true>>("CodedBF double hash", data, probes) && ok;
+    ok = bench_query_batch<ShiftingBloomFilter<num_bits, 8, 2>>("ShiftBF", data, probes) && ok;
+    ok = bench_query_batch<ShiftingBloomFilter<num_bits, 8, 2, uint64_t, true>>("ShiftBF double hash", data, probes) && ok;
+    return ok;
+}
+
+template<int class_num>
+void bench_shifting_bf(const KVList & data, const vector<uint64_t> & absent)
+{
+    const int num = int(data.size());
+    const int num_bits = 12 * (1 << 20);
+    typedef ShiftingBloomFilter<num_bits, 8, class_num> BF;
+    auto bf = new BF();
+    for (int i = 0; i < num; ++i) {
+        bf->insert(data[i].first, data[i].second % class_num);
+    }
+
+    int err_cnt = 0, fp_cnt = 0;
+    for (int i = 0; i < num; ++i) {
+        err_cnt += (bf->query(data[i].first) != int(data[i].second % class_num));
+        fp_cnt += (bf->query(absent[i]) != -1);
+    }
+
+    vector<uint64_t> keys;
+    for (auto & kv: data) {
+        keys.push_back(kv.first);
+    }
+    int sum = 0;
+    vector<int> results(num);
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < num; ++i) {
+        sum += bf->query(keys[i]);
+    }
+    auto t1 = chrono::steady_clock::now();
+    bf->query_batch(keys.data(), results.data(), num);
+    auto t2 = chrono::steady_clock::now();
+
+    auto ns = [&](chrono::steady_clock::duration d) {
+        return chrono::duration<double, nano>(d).count() / num;
+    };
+    // the previous layout was a uint32 per bit
+    printf("ShiftBF %2d classes: %zu bytes (was %zu), member error %.5f, fpr %.5f, query %.1f ns, "
+           "batch %.1f ns (checksum %d)\n", class_num, sizeof(BF), size_t(4) * (num_bits + class_num),
+           double(err_cnt) / num, double(fp_cnt) / num, ns(t1 - t0), ns(t2 - t1), sum);
+    delete bf;
+}
+
+bool test_shifting_bf()
+{
+    const int num = 1 << 20;
+    WorkloadSpec spec;
+    spec.seed = 17;
+    spec.class_num = 64;
+    spec.class_dist = CLASSES_UNIFORM;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    vector<uint64_t> absent = gen.aliens(num);
+
+    bench_shifting_bf<2>(data, absent);
+    bench_shifting_bf<8>(data, absent);
+    bench_shifting_bf<32>(data, absent);
+    bench_shifting_bf<33>(data, absent);
+    bench_shifting_bf<64>(data, absent);
+    return true;
+}
+
+template<typename BF>
+double time_queries(BF * bf, const vector<uint64_t> & probes, vector<int> & results)
+{
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        results[i] = bf->query(probes[i]);
+    }
+    auto t1 = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(t1 - t0).count() / probes.size();
+}
+
+// the run-time sized filters against the compile-time ones with the same parameters:
+// same answers, and the unrolled k paths should cost about the same
+template<int k>
+bool bench_dynamic_bf(const KVList & data, const vector<uint64_t> & probes)
+{
+    const int num_bits = 12 * (1 << 20);
+    auto smbf = new MultiBloomFilter<num_bits, k, 2>();
+    auto sshift = new ShiftingBloomFilter<num_bits, k, 2>();
+    DynamicMultiBloomFilter<> dmbf(num_bits, k, 2);
+    DynamicShiftingBloomFilter<> dshift(num_bits, k, 2);
+    for (auto & kv: data) {
+        smbf->insert(kv.first, kv.second);
+        sshift->insert(kv.first, kv.second);
+        dmbf.insert(kv.first, kv.second);
+        dshift.insert(kv.first, kv.second);
+    }
+
+    vector<int> r1(probes.size()), r2(probes.size()), r3(probes.size()), r4(probes.size());
+    double t_smbf = time_queries(smbf, probes, r1);
+    double t_dmbf = time_queries(&dmbf, probes, r2);
+    double t_sshift = time_queries(sshift, probes, r3);
+    double t_dshift = time_queries(&dshift, probes, r4);
+
+    size_t mismatch = 0;
+    for (size_t i = 0; i < probes.size(); ++i) {
+        mismatch += (r1[i] != r2[i]) + (r3[i] != r4[i]);
+    }
+    printf("k=%2d (%s): MultiBF static %.1f ns, dynamic %.1f ns | ShiftBF static %.1f ns, dynamic %.1f ns | "
+           "mismatches %zu\n", k, k <= max_fixed_k ? "unrolled" : "loop", t_smbf, t_dmbf, t_sshift, t_dshift,
+           mismatch);
+    delete smbf;
+    delete sshift;
+    return mismatch == 0;
+}
+
+bool test_dynamic_bf()
+{
+    const int num = 1 << 20;
+    WorkloadSpec spec;
+    spec.seed = 18;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    QueryMix mix;
+    mix.hit_rate = 0.5;
+    vector<uint64_t> probes = gen.queries(2 * num, num, mix);
+
+    bool ok = bench_dynamic_bf<4>(data, probes);
+    ok = bench_dynamic_bf<8>(data, probes) && ok;
+    ok = bench_dynamic_bf<11>(data, probes) && ok;
+    ok = bench_dynamic_bf<14>(data, probes) && ok;
+
+    // a configuration picked at run time, no instantiation needed
+    uint64_t bits = uint64_t(num) * 10;
+    DynamicCodedBloomFilter<uint64_t, true> coded(bits, 7, 4);
+    for (int i = 0; i < num; ++i) {
+        coded.insert(data[i].first, i % 4);
+    }
+    int err_cnt = 0;
+    for (int i = 0; i < num; ++i) {
+        err_cnt += (coded.query(data[i].first) != i % 4);
+    }
+    printf("DynCodedBF %lu bits, k=7, 4 classes, double hashing: member error %.5f\n",
+           (unsigned long)bits, double(err_cnt) / num);
+    return ok;
+}
+
+// One ingest run on a fresh engine from make(), built on data[0, base_num): producer_num threads
+// insert data[base_num, end) in slices while one reader queries the built keys. batch_size 0 is
+// the way producers do it today, insert() under a shared mutex; otherwise through an
+// IngestPipeline, where every producer flushes at the end and then checks its own keys through
+// the pipeline. right(answer, class) tells a correct answer, a filter may also say "several".
+template<typename Engine, typename Make, typename Right>
+bool bench_ingest(const char * label, Make make, Right right, int producer_num, size_t batch_size, KVList & data,
+                  int base_num)
+{
+    Engine * engine = make();
+    if (!engine->build(data, base_num)) {
+        delete engine;
+        return false;
+    }
+    size_t insert_num = data.size() - size_t(base_num);
+    mutex engine_lock;
+    IngestPipeline<Engine> * pipe = batch_size ? new IngestPipeline<Engine>(*engine, 4, 1 << 14, batch_size) : NULL;
+    auto query = [&](uint64_t key) -> int {
+        if (pipe) {
+            return int(pipe->query(key));
+        }
+        lock_guard<mutex> lock(engine_lock);
+        return int(engine->query(key));
+    };
+
+    atomic<int> running(producer_num);
+    atomic<uint64_t> wrong(0);
+    uint64_t reader_queries = 0, reader_wrong = 0;
+    thread reader([&] {
+        for (size_t i = 0; running.load(memory_order_relaxed) > 0; i = (i + 1) % size_t(base_num)) {
+            reader_wrong += !right(query(data[i].first), int(data[i].second));
+            reader_queries++;
+        }
+    });
+
+    auto t0 = chrono::steady_clock::now();
+    vector<thread> producers;
+    for (int p = 0; p < producer_num; ++p) {
+        producers.push_back(thread([&, p] {
+            size_t begin = base_num + insert_num * p / producer_num, end = base_num + insert_num * (p + 1) / producer_num;
+            for (size_t i = begin; i < end; ++i) {
+                if (pipe) {
+                    pipe->push(data[i].first, int(data[i].second));
+                } else {
+                    lock_guard<mutex> lock(engine_lock);
+                    engine->insert(data[i].first, int(data[i].second));
+                }
+            }
+            if (pipe) {
+                pipe->flush();
+            }
+            uint64_t w = 0;
+            for (size_t i = begin; i < end; ++i) {
+                w += !right(query(data[i].first), int(data[i].second));
+            }
+            wrong += w;
+            running.fetch_sub(1);
+        }));
+    }
+    for (auto & th: producers) {
+        th.join();
+    }
+    auto t1 = chrono::steady_clock::now();
+    reader.join();
+
+    double secs = chrono::duration<double>(t1 - t0).count();
+    string mode = pipe ? "batch " + to_string(batch_size) : "mutex";
+    printf("%-10s %-10s %2d producers: %10.1f k inserts/s, reader %6.2f Mq/s, wrong: %lu inserted, %lu built\n",
+           label, mode.c_str(), producer_num, insert_num / secs / 1e3, reader_queries / secs / 1e6,
+           (unsigned long)wrong.load(), (unsigned long)reader_wrong);
+    if (pipe) {
+        pipe->stop();
+        pipe->stats().dump(stdout);
+        delete pipe;
+    }
+    delete engine;
+    return wrong == 0 && reader_wrong == 0;
+}
+
+// producer_num threads feeding one engine, through a mutex and through the ingest pipeline.
+// A coloring embedder insert costs about a millisecond here (it grows with the buckets), so the
+// embedder run is small; the filter, with inserts of tens of ns, shows what the pipeline itself takes.
+// remembers the last class inserted for a key, so the order records are applied in shows
+struct LastClassEngine
+{
+    unordered_map<uint64_t, int> last;
+
+    void insert(uint64_t key, int class_id)
+    {
+        last[key] = class_id;
+    }
+
+    int query(uint64_t key) const
+    {
+        auto it = last.find(key);
+        return it == last.end() ? -1 : it->second;
+    }
+};
+
+// one thread pushes the same key into two pipelines in turn: each must apply its records in push order
+bool test_ingest_order()
+{
+    const int trial_num = 200, push_num = 200;
+    int out_of_order = 0;
+    for (int trial = 0; trial < trial_num; ++trial) {
+        LastClassEngine a, b;
+        IngestPipeline<LastClassEngine> pa(a, 4, 1 << 10, 16), pb(b, 4, 1 << 10, 16);
+        for (int i = 0; i < push_num; ++i) {
+            pa.push(7, i);
+            pb.push(7, i);
+        }
+        pa.flush();
+        pb.flush();
+        out_of_order += pa.query(7) != push_num - 1 || pb.query(7) != push_num - 1;
+    }
+    printf("one producer, two pipelines: %d of %d trials applied out of push order\n", out_of_order, trial_num);
+    return out_of_order == 0;
+}
+
+bool test_ingest(int producer_num)
+{
+    const int cc_base_num = 1 << 14, cc_insert_num = 1 << 12;
+    const int bf_base_num = 1 << 20, bf_insert_num = 1 << 22;
+    typedef ShiftingColoringClassifier<int((cc_base_num + cc_insert_num) * 1.25), 4, 2> CC;
+    typedef DynamicShiftingBloomFilter<> BF;
+    WorkloadSpec spec;
+    spec.seed = 50;
+    KVList cc_data = WorkloadGenerator(spec).kvs(cc_base_num + cc_insert_num);
+    KVList bf_data = WorkloadGenerator(spec).kvs(bf_base_num + bf_insert_num);
+    auto exact = [](int answer, int class_id) { return answer == class_id; };
+    // no false negatives: an inserted key answers its class or several classes
+    auto member = [](int answer, int class_id) { return answer == class_id || answer == -2; };
+
+    bool ok = true;
+    printf("%d keys built, %d inserted into CC4; %d built, %d inserted into DynShiftBF\n", cc_base_num,
+           cc_insert_num, bf_base_num, bf_insert_num);
+    for (size_t batch_size: {size_t(0), size_t(64), size_t(4096)}) {
+        ok = bench_ingest<CC>("CC4", []() { return new CC(50, 51); }, exact, producer_num, batch_size, cc_data,
+                              cc_base_num) && ok;
+    }
+    for (size_t batch_size: {size_t(0), size_t(64), size_t(4096)}) {
+        ok = bench_ingest<BF>("DynShiftBF", []() { return new BF(10ull * (bf_base_num + bf_insert_num), 7, 2); },
+                              member, producer_num, batch_size, bf_data, bf_base_num) && ok;
+    }
+
+    // the runs above are saturated, their visibility is mostly the wait in a full ring;
+    // this is push to visible on an idle pipeline, one record and a flush at a time
+    BF bf(10ull * bf_base_num, 7, 2);
+    IngestPipeline<BF> pipe(bf, 4, 1 << 14, 64);
+    LogLinearHistogram idle_ns;
+    for (int i = 0; i < 10000; ++i) {
+        uint64_t t0 = stats_now_ns();
+        pipe.push(bf_data[i].first, int(bf_data[i].second));
+        pipe.flush();
+        idle_ns.record(stats_now_ns() - t0);
+        ok = ok && member(pipe.query(bf_data[i].first), int(bf_data[i].second));
+    }
+    idle_ns.dump(stdout, "idle push to visible", "ns");
+    return test_ingest_order() && ok;
+}
+
+// checksum of the answers to a query stream, order-sensitive so a torn read anywhere shows
+template<typename Engine>
+uint64_t query_checksum(const Engine & engine, const vector<uint64_t> & keys)
+{
+    uint64_t sum = 0;
+    for (uint64_t key: keys) {
+        sum = sum * 31 + uint64_t(int64_t(engine.query(key)));
+    }
+    return sum;
+}
+
+// N reader threads on one built instance, through a const reference only: each thread replays
+// its own stream `passes` times and checks every pass against the single-threaded checksum.
+// Throughput is all queries over the wall time from the common start to the last thread done.
+template<typename Engine>
+bool bench_query_scaling(const char * label, const Engine & engine, const vector<vector<uint64_t>> & streams,
+                         const vector<int> & thread_nums, int passes)
+{
+    vector<uint64_t> expected(streams.size());
+    for (size_t t = 0; t < streams.size(); ++t) {
+        expected[t] = query_checksum(engine, streams[t]);
+    }
+
+    bool ok = true;
+    double base = 0;
+    for (int thread_num: thread_nums) {
+        atomic<int> ready(0);
+        atomic<bool> go(false);
+        vector<int> mismatches(thread_num, 0);
+        vector<thread> threads;
+        for (int t = 0; t < thread_num; ++t) {
+            threads.push_back(thread([&, t] {
+                ready.fetch_add(1);
+                while (!go.load(memory_order_acquire)) {
+                    this_thread::yield();
+                }
+                for (int pass = 0; pass < passes; ++pass) {
+                    mismatches[t] += query_checksum(engine, streams[t]) != expected[t];
+                }
+            }));
+        }
+        while (ready.load() < thread_num) {
+            this_thread::yield();
+        }
+        auto t0 = chrono::steady_clock::now();
+        go.store(true, memory_order_release);
+        for (auto & th: threads) {
+            th.join();
+        }
+        auto t1 = chrono::steady_clock::now();
+
+        int mismatch_num = 0;
+        for (int m: mismatches) {
+            mismatch_num += m;
+        }
+        double mqps = double(thread_num) * passes * streams[0].size() / chrono::duration<double, micro>(t1 - t0).count();
+        if (thread_num == thread_nums[0]) {
+            base = mqps / thread_num;
+        }
+        printf("%-12s %3d threads: %8.2f Mq/s, speedup %5.2f, efficiency %3.0f%%%s\n", label, thread_num, mqps,
+               mqps / base, 100.0 * mqps / base / thread_num, mismatch_num ? ", WRONG ANSWERS" : "");
+        ok = ok && mismatch_num == 0;
+    }
+    return ok;
+}
+
+// query scaling of the const query paths from 1 thread up to max_threads (default: the cores).
+// Past the core count the threads share cores, so the speedup can not keep growing there.
+bool test_query_scaling(int max_threads)
+{
+    const int num = 1 << 20;
+    const int bucket_num = int(num * 1.25);
+    const int num_bits = 10 * num;
+    const size_t stream_len = 1 << 20;
+    const int passes = 4;
+    int cores = int(thread::hardware_concurrency());
+    if (max_threads <= 0) {
+        max_threads = max(cores, 1);
+    }
+    vector<int> thread_nums;
+    for (int n = 1; n < max_threads; n *= 2) {
+        thread_nums.push_back(n);
+    }
+    thread_nums.push_back(max_threads);
+    printf("%d cores, up to %d reader threads, %d passes of %lu queries per thread\n", cores, max_threads, passes,
+           (unsigned long)stream_len);
+
+    WorkloadSpec spec;
+    spec.seed = 48;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    // 90% members, each thread its own stream
+    QueryMix mix;
+    mix.hit_rate = 0.9;
+    vector<vector<uint64_t>> streams(max_threads);
+    for (int t = 0; t < max_threads; ++t) {
+        streams[t] = gen.queries(stream_len, num, mix, uint64_t(t));
+    }
+
+    bool ok = true;
+    auto cc = new ShiftingColoringClassifier<bucket_num, 4, 2>(48, 49);
+    ok = cc->build(data, num) && ok;
+    ok = bench_query_scaling("CC4", *cc, streams, thread_nums, passes) && ok;
+    delete cc;
+
+    auto mbf = new MultiBloomFilter<num_bits, 7, 2>();
+    mbf->build(data, num);
+    ok = bench_query_scaling("MultiBF", *mbf, streams, thread_nums, passes) && ok;
+    delete mbf;
+
+    auto dsbf = new DynamicShiftingBloomFilter<>(num_bits, 7, 2);
+    dsbf->build(data, num);
+    ok = bench_query_scaling("DynShiftBF", *dsbf, streams, thread_nums, passes) && ok;
+    delete dsbf;
+
+    auto xr = new XorRetrieval<2>(48);
+    ok = xr->build(data, num) && ok;
+    ok = bench_query_scaling("XorRetrieval", *xr, streams, thread_nums, passes) && ok;
+    delete xr;
+    return ok;
+}
+
+// memory_usage() of each engine next to what the process really grew by, construction to end of build
+template<typename Engine>
+bool bench_memory_usage(const char * label, Engine * (*make)(), KVList & data)
+{
+    reset_peak_rss();
+    size_t rss0 = current_rss_bytes();
+    Engine * engine = make();
+    bool ok = engine->build(data, int(data.size()));
+    size_t rss1 = current_rss_bytes(), peak = peak_rss_bytes();
+    // hand the heap freed by the build back to the OS, what is left should be the engine
+    malloc_trim(0);
+    size_t rss2 = current_rss_bytes();
+    MemoryUsage m = engine->memory_usage();
+    m.dump(stdout, label, data.size());
+    auto mb = [&](size_t rss) { return (double(rss) - double(rss0)) / 1048576.0; };
+    printf("%*s  RSS grew %.2f MB, %.2f MB after malloc_trim, peak %.2f MB, for %.2f MB accounted\n",
+           int(strlen(label)), "", mb(rss1), mb(rss2), mb(peak), m.total() / 1048576.0);
+    delete engine;
+    return ok;
+}
+
+bool test_memory_usage()
+{
+    const int num = 1 << 18;
+    const int bucket_num = int(num * 1.25);
+    const int num_bits = 10 * num;
+    WorkloadSpec spec;
+    spec.seed = 47;
+    KVList data = WorkloadGenerator(spec).kvs(num);
+
+    bool ok = bench_memory_usage<ShiftingColoringClassifier<bucket_num, 4, 2>>("CC4", []() {
+        return new ShiftingColoringClassifier<bucket_num, 4, 2>(47, 48);
+    }, data);
+    ok = bench_memory_usage<MultiBloomFilter<num_bits, 7, 2>>("MultiBF", []() {
+        return new MultiBloomFilter<num_bits, 7, 2>();
+    }, data) && ok;
+    ok = bench_memory_usage<DynamicShiftingBloomFilter<>>("DynShiftBF", []() {
+        return new DynamicShiftingBloomFilter<>(num_bits, 7, 2);
+    }, data) && ok;
+    ok = bench_memory_usage<XorRetrieval<2>>("XorRetrieval", []() { return new XorRetrieval<2>(47); }, data) && ok;
+    return ok;
+}
+
+// the generator of workload.h: distinct keys and aliens without a dedup set, class shares,
+// Zipf ranks against 1 / r^s, hit rate, reproducibility, and dedup_keys against unordered_set
+bool test_workload()
+{
+    const int num = 1 << 20;
+    bool ok = true;
+
+    WorkloadSpec spec;
+    spec.seed = 7;
+    spec.key_bits = 40;
+    spec.class_num = 4;
+    spec.class_dist = CLASSES_SKEWED;
+    spec.class_skew = 2.0;
+    WorkloadGenerator gen(spec);
+
+    auto t0 = chrono::steady_clock::now();
+    KVList data = gen.kvs(num);
+    vector<uint64_t> aliens = gen.aliens(num);
+    auto t1 = chrono::steady_clock::now();
+
+    vector<uint64_t> all;
+    for (auto & kv: data) {
+        all.push_back(kv.first);
+        ok = ok && kv.first < (1ull << 40);
+    }
+    all.insert(all.end(), aliens.begin(), aliens.end());
+    vector<uint64_t> copy = all;
+    auto t2 = chrono::steady_clock::now();
+    size_t removed = dedup_keys(all);
+    auto t3 = chrono::steady_clock::now();
+    unordered_set<uint64_t> filter;
+    for (uint64_t key: copy) {
+        filter.insert(key);
+    }
+    auto t4 = chrono::steady_clock::now();
+    auto ns = [&](chrono::steady_clock::duration d) { return chrono::duration<double, nano>(d).count() / copy.size(); };
+    printf("%d keys + %d aliens in %.1f ns/key, repeated: %lu; dedup_keys %.1f ns/key, unordered_set %.1f ns/key\n",
+           num, num, ns(t1 - t0), (unsigned long)removed, ns(t3 - t2), ns(t4 - t3));
+    ok = ok && removed == 0 && filter.size() == copy.size();
+
+    // 1 / (c + 1)^2 over 4 classes: 0.702, 0.175, 0.078, 0.044
+    vector<int> class_cnt(spec.class_num, 0);
+    for (auto & kv: data) {
+        class_cnt[kv.second]++;
+    }
+    printf("class shares:");
+    for (uint32_t c = 0; c < spec.class_num; ++c) {
+        printf(" %.3f", double(class_cnt[c]) / num);
+    }
+    printf("\n");
+    ok = ok && fabs(double(class_cnt[0]) / num - 0.702) < 0.01;
+
+    QueryMix mix;
+    mix.dist = QUERIES_ZIPF;
+    mix.zipf_s = 0.99;
+    mix.hit_rate = 0.9;
+    vector<int> expected;
+    auto t5 = chrono::steady_clock::now();
+    vector<uint64_t> queries = gen.queries(num, num, mix, 0, &expected);
+    auto t6 = chrono::steady_clock::now();
+    int hit_cnt = 0, top_cnt[3] = {0, 0, 0};
+    for (int q = 0; q < num; ++q) {
+        hit_cnt += expected[q] >= 0;
+        for (int r = 0; r < 3; ++r) {
+            top_cnt[r] += queries[q] == data[r].first || queries[q] == aliens[r];
+        }
+    }
+    double zeta = 0;
+    for (int r = 1; r <= num; ++r) {
+        zeta += pow(r, -mix.zipf_s);
+    }
+    printf("zipf %.2f queries in %.1f ns/query, hit rate %.4f\n", mix.zipf_s,
+           chrono::duration<double, nano>(t6 - t5).count() / num, double(hit_cnt) / num);
+    for (int r = 0; r < 3; ++r) {
+        double want = pow(r + 1, -mix.zipf_s) / zeta;
+        printf("  rank %d: %.4f, expected %.4f\n", r + 1, double(top_cnt[r]) / num, want);
+        ok = ok && fabs(double(top_cnt[r]) / num - want) < 0.1 * want;
+    }
+    ok = ok && fabs(double(hit_cnt) / num - mix.hit_rate) < 0.01;
+
+    WorkloadGenerator again(spec);
+    ok = ok && again.kvs(1000) == KVList(data.begin(), data.begin() + 1000)
+         && again.queries(1000, num, mix) == vector<uint64_t>(queries.begin(), queries.begin() + 1000);
+
+    WorkloadSpec seq_spec;
+    seq_spec.key_order = KEYS_SEQUENTIAL;
+    seq_spec.start = 1000;
+    WorkloadGenerator seq(seq_spec);
+    ok = ok && seq.key(0) == 1000 && seq.key(5) == 1005 && seq.class_of(5) == 1 && seq.alien(0) == 1000 + (1ull << 63);
+
+    printf("workload generator: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// the per-phase profile of one build, as text and JSON, and what the profiling itself costs
+bool test_build_profile()
+{
+    const int num = 1 << 20;
+    typedef ShiftingColoringClassifier<int(num * 1.25), 4, 2> CC;
+
+    WorkloadSpec spec;
+    spec.seed = 43;
+    KVList data = WorkloadGenerator(spec).kvs(num);
+
+    auto cc = new CC(43, 44);
+    auto t0 = chrono::steady_clock::now();
+    bool ok = cc->build(data, num);
+    auto t1 = chrono::steady_clock::now();
+    cc->build_profile.dump(stdout);
+    cc->build_profile.write_json(stdout);
+    printf("build() from outside: %.2f ms\n", chrono::duration<double, milli>(t1 - t0).count());
+
+    const int timer_num = 100000;
+    BuildProfile scratch;
+    auto t2 = chrono::steady_clock::now();
+    for (int i = 0; i < timer_num; ++i) {
+        PhaseTimer timer(scratch, PHASE_SYNC);
+    }
+    auto t3 = chrono::steady_clock::now();
+    printf("one phase costs %.2f us to profile, %d phases in this build\n",
+           chrono::duration<double, micro>(t3 - t2).count() / timer_num, [&]() {
+               int n = 0;
+               for (auto & p: cc->build_profile.phases) {
+                   n += int(p.calls);
+               }
+               return n;
+           }());
+    ok = ok && cc->build_profile.ok;
+    delete cc;
+    return ok;
+}
+
+// the outcome mix and latency tail of incremental inserts after a build
+bool test_insert_stats()
+{
+    const int num = 50000, insert_num = 5000;
+    typedef ShiftingColoringClassifier<int(num * 1.25), 4, 2> CC;
+
+    WorkloadSpec spec;
+    spec.seed = 42;
+    KVList data = WorkloadGenerator(spec).kvs(num + insert_num);
+
+    auto cc = new CC(42, 43);
+    bool ok = cc->build(data, num);
+    for (int i = num; i < num + insert_num; ++i) {
+        cc->insert(data[i].first, data[i].second);
+    }
+    cc->insert_stats.dump(stdout);
+
+    int err_cnt = 0;
+    for (auto & kv: data) {
+        err_cnt += (cc->query(kv.first) != kv.second);
+    }
+    ok = ok && cc->insert_stats.total() == uint64_t(insert_num);
+    printf("%d errors after %d inserts, %d in the overflow table\n", err_cnt, insert_num, cc->OverFlowTable.size());
+    delete cc;
+    return ok;
+}
+
+// bits per key, build Mkeys/s, member query ns/op and member errors of one static engine
+// size() gives the bytes of the engine after the build
+template<typename Engine, typename Size>
+bool bench_retrieval_engine(Engine * engine, Size size, KVList & data, const vector<uint64_t> & probes)
+{
+    auto t0 = chrono::steady_clock::now();
+    bool build_result = engine->build(data, int(data.size()));
+    auto t1 = chrono::steady_clock::now();
+    size_t bytes = size();
+
+    vector<int> results(probes.size());
+    double t_query = time_queries(engine, probes, results);
+    unordered_map<uint64_t, uint32_t> cls(data.begin(), data.end());
+    size_t err_cnt = 0;
+    for (size_t i = 0; i < probes.size(); ++i) {
+        err_cnt += (results[i] != int(cls[probes[i]]));
+    }
+    printf("%-14s %d classes: %5.2f bits/key, build %6.2f Mkeys/s, query %5.1f ns, member error %.5f%s\n",
+           engine->name.c_str(), Engine::_class_num, 8.0 * bytes / data.size(),
+           data.size() / chrono::duration<double, micro>(t1 - t0).count(), t_query,
+           double(err_cnt) / probes.size(), build_result ? "" : " (build failed)");
+    return build_result;
+}
+
+// the XOR retrieval baseline against the embedder and MultiBF on the same keys
+template<int class_num>
+bool bench_retrieval()
+{
+    const int num = 1 << 20;
+    const int bucket_num = int(num * 1.25 * log2(class_num));
+    const int mbf_bits = 10 * num;
+    WorkloadSpec spec;
+    spec.seed = 40;
+    spec.class_num = class_num;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    vector<uint64_t> probes = gen.queries(num, num, QueryMix());
+
+    auto xr = new XorRetrieval<class_num>(40);
+    bool ok = bench_retrieval_engine(xr, [&]() { return xr->size_bytes(); }, data, probes);
+    delete xr;
+
+    typedef ShiftingColoringClassifier<bucket_num, 4, class_num> CC;
+    auto cc = new CC(40, 41);
+    // packed 2-bit colors, plus a key and a class per overflow entry
+    ok = bench_retrieval_engine(cc, [&]() { return ColorStorage<4>::bytes(bucket_num); }, data, probes) && ok;
+    printf("%-14s %d overflow entries not counted in bits/key\n", "", cc->OverFlowTable.size());
+    delete cc;
+
+    auto mbf = new MultiBloomFilter<mbf_bits, 7, class_num>();
+    ok = bench_retrieval_engine(mbf, [&]() { return mbf_bits / 8; }, data, probes) && ok;
+    delete mbf;
+    return ok;
+}
+
+bool test_retrieval()
+{
+    bool ok = bench_retrieval<2>();
+    ok = bench_retrieval<4>() && ok;
+
+    // 13-byte keys and a class count that is not a power of two
+    KeyValueList<FlowKey> flows;
+    mt19937 gen(41);
+    for (int i = 0; i < 100000; ++i) {
+        FlowKey key;
+        for (size_t j = 0; j < sizeof(key); ++j) {
+            ((uint8_t *)&key)[j] = uint8_t(gen());
+        }
+        flows.push_back(make_pair(key, uint32_t(i % 5)));
+    }
+    XorRetrieval<5, FlowKey> xr;
+    ok = xr.build(flows, int(flows.size())) && ok;
+    int err_cnt = 0;
+    for (auto & kv: flows) {
+        err_cnt += (xr.query(kv.first) != int(kv.second));
+    }
+    printf("XorRetrieval 13-byte keys, 5 classes: %d errors, %.2f bits/key\n", err_cnt,
+           8.0 * xr.size_bytes() / flows.size());
+    return ok && err_cnt == 0;
+}
+
+// AnonHugePages of this process in kB, -1 where the kernel does not report it
+long anon_huge_kb()
+{
+    FILE * f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// query latency of 512 MB filters and build / query time of a classifier, with the arrays
+// on 4 KB pages and on 2 MB pages; the answers must not depend on the setting
+bool bench_huge_pages(bool huge, vector<int> & answers)
+{
+    set_huge_pages(huge);
+    const uint64_t num_bits = (4ull << 30) - 1024;
+    const int num = 1 << 22;
+    const int cc_num = 1 << 21;
+    WorkloadSpec spec;
+    spec.seed = 39;
+    WorkloadGenerator gen(spec);
+    KVList data = gen.kvs(num);
+    QueryMix mix;
+    mix.hit_rate = 0.5;
+    vector<uint64_t> probes = gen.queries(2 * num, num, mix);
+
+    vector<int> r1(probes.size()), r2(probes.size()), r3(probes.size());
+    long huge_before = anon_huge_kb();
+    double t_mbf, t_shift, t_build, t_cc;
+    long huge_mbf, huge_cc;
+    bool cc_result;
+    int cc_err = 0;
+    {
+        DynamicMultiBloomFilter<uint64_t, true> mbf(num_bits, 4, 2);
+        for (auto & kv: data) {
+            mbf.insert(kv.first, kv.second);
+        }
+        huge_mbf = anon_huge_kb() - huge_before;
+        t_mbf = time_queries(&mbf, probes, r1);
+    }
+    {
+        DynamicShiftingBloomFilter<uint64_t, true> shift(num_bits, 4, 2);
+        for (auto & kv: data) {
+            shift.insert(kv.first, kv.second);
+        }
+        t_shift = time_queries(&shift, probes, r2);
+    }
+    {
+        typedef ShiftingColoringClassifier<int(cc_num * 1.11), 4, 2> CC;
+        KVList cc_data(data.begin(), data.begin() + cc_num);
+        auto t0 = chrono::steady_clock::now();
+        auto cc = new CC(39, 40);
+        cc_result = cc->build(cc_data, cc_num);
+        auto t1 = chrono::steady_clock::now();
+        t_build = chrono::duration<double>(t1 - t0).count();
+        huge_cc = anon_huge_kb() - huge_before;
+        t_cc = time_queries(cc, probes, r3);
+        for (auto & kv: cc_data) {
+            cc_err += (cc->query(kv.first) != kv.second);
+        }
+        delete cc;
+    }
+
+    printf("huge pages %-3s: DynMultiBF 512 MB %.1f ns, DynShiftBF 512 MB %.1f ns | ShiftingCC %d keys build %s "
+           "in %.2f s, query %.1f ns, errors %d | AnonHugePages +%ld MB (filter), +%ld MB (classifier)\n",
+           huge ? "on" : "off", t_mbf, t_shift, cc_num, cc_result ? "success" : "failed", t_build, t_cc, cc_err,
+           huge_mbf / 1024, huge_cc / 1024);
+    if (!cc_result || cc_err) {
+        return false;
+    }
+
+    // the classifier is checked on its members above: the order its groups are colored in follows
+    // their heap addresses, so what a non-member gets differs between two builds, huge pages or not
+    vector<int> all;
+    all.insert(all.end(), r1.begin(), r1.end());
+    all.insert(all.end(), r2.begin(), r2.end());
+    if (answers.empty()) {
+        answers.swap(all);
+        return true;
+    }
+    return answers == all;
+}
+
+bool test_huge_pages()
+{
+    vector<int> answers;
+    bool ok = bench_huge_pages(false, answers);
+    ok = bench_huge_pages(true, answers) && ok;
+    printf("%s\n", ok ? "filter answers identical, classifier answers correct for every member" : "failed");
+    return ok;
+}
+
+void run_two_set()
 {
     int N = 30;
     for(int i = 0; i < N; i++){
@@ -140,6 +1682,75 @@ int main()
     cout << endl;
     cout << max_size<<endl;
     cout <<"error_0_cnt: " << err_0_cnt <<endl;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "ingest") == 0) {
+        return test_ingest(argc > 2 ? atoi(argv[2]) : 4) ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "readers") == 0) {
+        return test_query_scaling(argc > 2 ? atoi(argv[2]) : 0) ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "memory") == 0) {
+        return test_memory_usage() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "workload") == 0) {
+        return test_workload() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "profile") == 0) {
+        return test_build_profile() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "insertstats") == 0) {
+        return test_insert_stats() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "retrieval") == 0) {
+        return test_retrieval() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "hugepages") == 0) {
+        return test_huge_pages() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "concurrent") == 0) {
+        return test_concurrent_build() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "sharded") == 0) {
+        return test_sharded() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "strings") == 0) {
+        return test_string_keys() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "storage") == 0) {
+        return test_color_storage() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "growing") == 0) {
+        return test_growing() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "dynamic") == 0) {
+        return test_dynamic_bf() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "shiftbf") == 0) {
+        return test_shifting_bf() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+        return test_query_batch() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "doublehash") == 0) {
+        return test_probe_hash() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "blocked") == 0) {
+        return test_blocked_bf() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "keytypes") == 0) {
+        return test_key_types() ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "mapped") == 0) {
+        return test_mapped(argc > 2 ? argv[2] : "cc_image.bin") ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "snapshot") == 0) {
+        return test_snapshot(argc > 2 ? argv[2] : "cc_snapshot.bin") ? 0 : 1;
+    }
+
+    run_two_set();
     return 0;
 }
 
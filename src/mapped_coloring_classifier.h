@@ -0,0 +1,170 @@
+#ifndef COLORINGCLASSIFER_MAPPED_COLORING_CLASSIFIER_H
+#define COLORINGCLASSIFER_MAPPED_COLORING_CLASSIFIER_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "BOB_hash.h"
+#include "coloring_classifier.h"
+#include "query_image.h"
+#include "color_storage.h"
+#include "key_types.h"
+
+using namespace std;
+
+// Answers queries straight from an image written by save_image(), nothing is parsed or copied,
+// so opening is O(1) and processes mapping the same file share one copy in the page cache.
+// query() returns the class id like ShiftingColoringClassifier does (1 for pos edges with one offset).
+template<int32_t COLOR_NUM = 4, typename Key = uint64_t>
+class MappedColoringClassifier
+{
+    typedef ColorStorage<COLOR_NUM> Storage;
+    typedef ImageOverflow<Key> Overflow;
+
+    const char * base;
+    size_t size;
+    const ImageHeader * header;
+    const uint8_t * buckets;
+    const Overflow * overflow;
+    BOBHash hash1, hash2;
+
+    void close()
+    {
+        if (base) {
+            munmap((void *)base, size);
+        }
+        base = NULL;
+        size = 0;
+        header = NULL;
+    }
+
+    // [offset, offset + len) lies after the header and inside the mapping, without wrapping around
+    bool section_fits(uint64_t offset, uint64_t len) const
+    {
+        return offset >= sizeof(ImageHeader) && offset <= size && len <= size - offset;
+    }
+
+    int query_overflow(const Key & key) const
+    {
+        size_t lo = 0, hi = header->overflow_num;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (key_less(overflow[mid].key, key)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < header->overflow_num && overflow[lo].key == key) {
+            return int(overflow[lo].class_id);
+        }
+        return -1;
+    }
+
+public:
+    string name;
+
+    MappedColoringClassifier() : base(NULL), size(0), header(NULL), buckets(NULL), overflow(NULL),
+                                 hash1(0), hash2(0), name("MappedCC")
+    {
+    }
+
+    MappedColoringClassifier(const MappedColoringClassifier &) = delete;
+    MappedColoringClassifier & operator=(const MappedColoringClassifier &) = delete;
+
+    bool open(const char * path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Image %s not found\n", path);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ImageHeader)) {
+            fprintf(stderr, "%s is not an image\n", path);
+            ::close(fd);
+            return false;
+        }
+        void * p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "Cannot map %s\n", path);
+            return false;
+        }
+        base = (const char *)p;
+        size = st.st_size;
+        header = (const ImageHeader *)base;
+
+        if (memcmp(header->magic, image_magic, sizeof(header->magic)) != 0 || header->version != IMAGE_VERSION ||
+            header->file_size != size || header->bucket_num == 0 || header->color_num != uint32_t(COLOR_NUM) ||
+            header->key_size != sizeof(Key) || header->offset_num >= 32 ||
+            header->buckets_size != Storage::bytes(header->bucket_num) ||
+            header->buckets_offset % IMAGE_ALIGN != 0 || !section_fits(header->buckets_offset, header->buckets_size) ||
+            header->overflow_offset % 8 != 0 || header->overflow_num > size / sizeof(Overflow) ||
+            !section_fits(header->overflow_offset, header->overflow_num * sizeof(Overflow)) ||
+            header->overflow_offset + header->overflow_num * sizeof(Overflow) != size ||
+            header->overflow_offset < header->buckets_offset + header->buckets_size) {
+            fprintf(stderr, "%s is not a valid image\n", path);
+            close();
+            return false;
+        }
+
+        buckets = (const uint8_t *)(base + header->buckets_offset);
+        overflow = (const Overflow *)(base + header->overflow_offset);
+        hash1 = BOBHash(header->seed1);
+        hash2 = BOBHash(header->seed2);
+        name = "MappedCC" + string(1, char('0' + COLOR_NUM));
+        return true;
+    }
+
+    uint32_t query(const Key & key) const
+    {
+        int ret = query_overflow(key);
+        if (ret != -1) {
+            return ret;
+        }
+
+        uint32_t a, b;
+        uint32_t bucket_num = header->bucket_num;
+        cc_hash_pair(key, hash1, hash2, bucket_num, a, b);
+
+        ret = 0;
+        for (uint32_t k = 0; k < header->offset_num; ++k) {
+            int c1 = Storage::get(buckets, (a + k) % bucket_num);
+            int c2 = Storage::get(buckets, (b + k) % bucket_num);
+            ret |= ((c1 == c2 ? 0 : 1u) << k);
+        }
+        return ret;
+    }
+
+    size_t mapped_size() const
+    {
+        return size;
+    }
+
+    // the mapped image: colors and overflow records, the header and padding as overhead.
+    // These are file pages shared through the page cache, not heap.
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        if (header) {
+            m.query_bytes = Storage::bytes(header->bucket_num);
+            m.overflow_bytes = header->overflow_num * sizeof(Overflow);
+            m.overhead_bytes = size - m.query_bytes - m.overflow_bytes;
+        }
+        m.overhead_bytes += sizeof(*this);
+        return m;
+    }
+
+    ~MappedColoringClassifier()
+    {
+        close();
+    }
+};
+
+#endif //COLORINGCLASSIFER_MAPPED_COLORING_CLASSIFIER_H
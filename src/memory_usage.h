@@ -0,0 +1,195 @@
+#ifndef COLORINGCLASSIFER_MEMORY_USAGE_H
+#define COLORINGCLASSIFER_MEMORY_USAGE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include "huge_page_alloc.h"
+
+using namespace std;
+
+// What an engine holds, from memory_usage(). The four parts add up to the bytes the engine
+// takes from the allocator (as allocated with new, for the engines whose arrays are in the object):
+//   query     read by query(): packed colors, filter words, retrieval slots
+//   build     kept only for build() and insert(): union-find buckets, edges, group sets,
+//             retained keys, counters
+//   overflow  payload of the overflow table, which query() also reads
+//   overhead  what the allocator adds: malloc headers and rounding, hash table buckets and
+//             node links, vector capacity beyond the size, huge page rounding
+// Heap blocks are estimated from the glibc malloc layout, not measured.
+struct MemoryUsage
+{
+    size_t query_bytes;
+    size_t build_bytes;
+    size_t overflow_bytes;
+    size_t overhead_bytes;
+
+    MemoryUsage() : query_bytes(0), build_bytes(0), overflow_bytes(0), overhead_bytes(0) {}
+
+    size_t total() const
+    {
+        return query_bytes + build_bytes + overflow_bytes + overhead_bytes;
+    }
+
+    // what a query-only copy (a snapshot image) needs
+    size_t query_total() const
+    {
+        return query_bytes + overflow_bytes;
+    }
+
+    MemoryUsage & operator+=(const MemoryUsage & other)
+    {
+        query_bytes += other.query_bytes;
+        build_bytes += other.build_bytes;
+        overflow_bytes += other.overflow_bytes;
+        overhead_bytes += other.overhead_bytes;
+        return *this;
+    }
+
+    // bits per key as well when keys is given
+    void dump(FILE * f, const char * label, size_t keys = 0) const
+    {
+        fprintf(f, "%s: %.2f MB total, query %.2f MB, build %.2f MB, overflow %.2f MB, overhead %.2f MB", label,
+                total() / 1048576.0, query_bytes / 1048576.0, build_bytes / 1048576.0, overflow_bytes / 1048576.0,
+                overhead_bytes / 1048576.0);
+        if (keys) {
+            fprintf(f, " | %.2f bits/key for queries, %.2f in total", 8.0 * query_total() / keys, 8.0 * total() / keys);
+        }
+        fprintf(f, "\n");
+    }
+};
+
+// bytes glibc malloc takes for a request of n: an 8-byte header, 16-byte granularity,
+// 32 at least, and whole pages for the blocks it maps (128 KB and more by default)
+inline size_t malloc_chunk_bytes(size_t n)
+{
+    if (n >= (128 << 10)) {
+        return (n + 16 + 4095) / 4096 * 4096;
+    }
+    size_t chunk = (n + 8 + 15) / 16 * 16;
+    return chunk < 32 ? 32 : chunk;
+}
+
+// bytes huge_alloc reserves for a block of n
+inline size_t huge_alloc_bytes(size_t n)
+{
+    if (n < huge_page_size) {
+        // aligned_alloc(64): rounded to a cache line, plus up to one line to align the chunk
+        return malloc_chunk_bytes((n ? (n + 63) / 64 * 64 : 64) + 64);
+    }
+    return huge_round(n);
+}
+
+// the heap block of a vector: size() elements to `field`, the rest to overhead
+template<typename T, typename A>
+inline void add_vector_usage(MemoryUsage & m, size_t MemoryUsage::* field, const vector<T, A> & v)
+{
+    if (v.capacity() == 0) {
+        return;
+    }
+    m.*field += v.size() * sizeof(T);
+    m.overhead_bytes += malloc_chunk_bytes(v.capacity() * sizeof(T)) - v.size() * sizeof(T);
+}
+
+// the heap part of a node-based unordered_* (libstdc++): a bucket array, unless there is only the
+// single bucket kept in the object, and one node per element with the value and a next link.
+// node_extra is the hash code cached in the node, sizeof(size_t) for hashes that are not "fast".
+template<typename Table>
+inline void add_hash_table_usage(MemoryUsage & m, size_t MemoryUsage::* field, const Table & t,
+                                 size_t node_extra = 0, bool huge_buckets = false)
+{
+    typedef typename Table::value_type Value;
+    size_t bucket_bytes = t.bucket_count() * sizeof(void *);
+    if (t.bucket_count() > 1) {
+        m.overhead_bytes += huge_buckets && bucket_bytes >= huge_page_size ? huge_round(bucket_bytes)
+                                                                           : malloc_chunk_bytes(bucket_bytes);
+    }
+    m.*field += t.size() * sizeof(Value);
+    m.overhead_bytes += t.size() * (malloc_chunk_bytes(sizeof(void *) + sizeof(Value) + node_extra) - sizeof(Value));
+}
+
+// /proc/self/status field in bytes, 0 where /proc is missing
+inline size_t proc_status_bytes(const char * field)
+{
+    int fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return 0;
+    }
+    buf[n] = 0;
+    size_t len = strlen(field);
+    for (char * p = buf; p; ) {
+        if (strncmp(p, field, len) == 0 && p[len] == ':') {
+            return size_t(strtoull(p + len + 1, NULL, 10)) * 1024;
+        }
+        p = strchr(p, '\n');
+        p = p ? p + 1 : NULL;
+    }
+    return 0;
+}
+
+inline size_t current_rss_bytes()
+{
+    return proc_status_bytes("VmRSS");
+}
+
+// the peak a restart_peak_rss() cleared, so an outer measurement still sees it
+inline atomic<size_t> & carried_peak_rss()
+{
+    static atomic<size_t> peak(0);
+    return peak;
+}
+
+inline bool clear_peak_rss()
+{
+    int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+// Peak RSS (VmHWM) since the last reset_peak_rss(), so the peak of one build can be measured
+// on its own. Resetting needs Linux 4.0; without it the peak is since the start of the process.
+inline bool reset_peak_rss()
+{
+    carried_peak_rss().store(0, memory_order_relaxed);
+    return clear_peak_rss();
+}
+
+// Starts a nested measurement: VmHWM (peak_since_restart_rss_bytes()) restarts from the current
+// RSS, while peak_rss_bytes() keeps the peak since the last reset_peak_rss().
+inline bool restart_peak_rss()
+{
+    size_t hwm = proc_status_bytes("VmHWM");
+    auto & carried = carried_peak_rss();
+    size_t old = carried.load(memory_order_relaxed);
+    while (old < hwm && !carried.compare_exchange_weak(old, hwm, memory_order_relaxed)) {
+    }
+    return clear_peak_rss();
+}
+
+inline size_t peak_since_restart_rss_bytes()
+{
+    return proc_status_bytes("VmHWM");
+}
+
+inline size_t peak_rss_bytes()
+{
+    size_t hwm = proc_status_bytes("VmHWM"), carried = carried_peak_rss().load(memory_order_relaxed);
+    return hwm > carried ? hwm : carried;
+}
+
+#endif //COLORINGCLASSIFER_MEMORY_USAGE_H
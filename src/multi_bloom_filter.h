@@ -3,33 +3,35 @@
 
 #include "multi_way_bf.h"
 #include "BOB_hash.h"
+#include "utils.h"
 
-template<int num_bits, int k, int class_num = 2>
-class MultiBloomFilter: public MultiWayBloomFilter<num_bits, k, class_num>
+template<int num_bits, int k, int class_num = 2, typename Key = uint64_t, bool blocked = false,
+         bool double_hashing = false>
+class MultiBloomFilter: public MultiWayBloomFilter<num_bits, k, class_num, Key, blocked, double_hashing>
 {
 public:
     const string name;
     constexpr static int _class_num = class_num;
 
-    MultiBloomFilter() : name("MultiBF")
+    MultiBloomFilter() : name(blocked ? "BlockedMultiBF" : "MultiBF")
     {
     }
 
-    void insert(uint64_t key, int class_id)
+    void insert(const Key & key, int class_id)
     {
-        MultiWayBloomFilter<num_bits, k, class_num>::insert_bf(key, class_id);
+        MultiWayBloomFilter<num_bits, k, class_num, Key, blocked, double_hashing>::insert_bf(key, class_id);
     }
 
-    int query(uint64_t key)
+    int query(const Key & key) const
     {
         int result = -2;
-        uint32_t qr = MultiWayBloomFilter<num_bits, k, class_num>::query_multiway(key);
+        uint32_t qr = MultiWayBloomFilter<num_bits, k, class_num, Key, blocked, double_hashing>::query_multiway(key);
 //        if (!qr) {
 //            return -2;
 //        }
 
 //        for (int i = 0; i < class_num; ++i) {
-//            if (MultiWayBloomFilter<num_bits, k, class_num>::query_bf(key, i))
+//            if (MultiWayBloomFilter<num_bits, k, class_num, Key, blocked, double_hashing>::query_bf(key, i))
 //                return i;
 //        }
 
@@ -45,8 +47,25 @@ public:
         return result;
     }
 
+    // query() of keys[0 .. num) into results
+    void query_batch(const Key * keys, int * results, size_t num) const
+    {
+        size_t i = 0;
+#ifdef __AVX2__
+        if constexpr (MultiWayBloomFilter<num_bits, k, class_num, Key, blocked, double_hashing>::simd_batch) {
+            for (; i + 8 <= num; i += 8) {
+                __m256i qr = MultiWayBloomFilter<num_bits, k, class_num, Key, blocked, double_hashing>::query_multiway_x8(keys + i);
+                _mm256_storeu_si256((__m256i *)(results + i), simd_decode(qr, -2, -1));
+            }
+        }
+#endif
+        for (; i < num; ++i) {
+            results[i] = query(keys[i]);
+        }
+    }
+
 
-    bool build(KVList & kvs, int num)
+    bool build(KeyValueList<Key> & kvs, int num)
     {
         for (int i = 0; i < num; ++i) {
             insert(kvs[i].first, kvs[i].second);
@@ -55,7 +74,7 @@ public:
         return true;
     }
 
-    bool exp_build(uint64_t * keys, int num)
+    bool exp_build(Key * keys, int num)
     {
         for (int i = 0; i < num / 2; ++i) {
             insert(keys[i], 0);
@@ -4,53 +4,124 @@
 #include <cstdio>
 #include <cstring>
 #include "BOB_hash.h"
+#include "bloom_hash.h"
+#include "bloom_simd.h"
+#include "huge_page_alloc.h"
+#include "memory_usage.h"
 
-template<uint64_t num_bits, int k, int way>
+// blocked: one hash picks a 64-byte block and all k probes of every way fall inside it,
+// so a query touches one cache line. A slot (the `way` bits of one probe) never crosses a
+// 32-bit word there, a word holds 32 / way slots and the leftover bits are unused.
+// double_hashing: the k probes come from one hash of the key, see bloom_hash.h
+template<uint64_t num_bits, int k, int way, typename Key = uint64_t, bool blocked = false, bool double_hashing = false>
 class MultiWayBloomFilter
 {
+    typedef ProbeHash<Key, k, double_hashing> Hash;
+
     static constexpr uint64_t bit_per_bf = num_bits / way;
     static constexpr uint64_t dword_per_bf = (bit_per_bf + 31) / 32;
-    uint32_t bf[way * dword_per_bf];
+
+    static constexpr uint32_t slot_per_word = 32 / way;
+    static constexpr uint32_t slot_per_block = 16 * slot_per_word;
+    static constexpr uint64_t block_num = (num_bits + 511) / 512;
+    static_assert(double_hashing || k < 32, "only 32 BOB hash functions");
+
+    // the unblocked layout reads the word after the one of a probe, one padding word keeps the last in bounds
+    alignas(blocked ? 64 : alignof(uint32_t)) uint32_t bf[blocked ? block_num * 16 : way * dword_per_bf + 1];
+
 protected:
-    void insert_bf(uint64_t key, int idx)
+    void insert_bf(const Key & key, int idx)
     {
-        for (int i = 0; i < k; ++i) {
-            uint64_t pos = BOB_hashs[i](&key) % bit_per_bf;
+        Hash h(key);
+        if (blocked) {
+            uint32_t * block = bf + h.block(block_num) * 16;
+            for_probes<k>([&](auto i) {
+                uint32_t slot = h.template probe<decltype(i)::value>() % slot_per_block;
+                block[slot / slot_per_word] |= 1u << (slot % slot_per_word * way + idx);
+                return true;
+            });
+            return;
+        }
+        for_probes<k>([&](auto i) {
+            uint64_t pos = h.template probe<decltype(i)::value>() % bit_per_bf;
             pos = pos * way + idx;
             bf[pos / 32] |= 1u << (pos % 32);
-        }
+            return true;
+        });
     }
 
-    uint32_t query_bf(uint64_t key, int idx)
+    uint32_t query_bf(const Key & key, int idx) const
     {
-        uint32_t ret = 1;
-        for (int i = 0; i < k; ++i) {
-            uint64_t pos = BOB_hashs[i](&key) % bit_per_bf;
-            pos = pos * way + idx;
-            ret &= 1 & (bf[pos / 32] >> (pos % 32));
-            if (!ret) return 0;
+        if (blocked) {
+            return (query_multiway(key) >> idx) & 1;
         }
-        return 1;
+        Hash h(key);
+        return for_probes<k>([&](auto i) {
+            uint64_t pos = h.template probe<decltype(i)::value>() % bit_per_bf;
+            pos = pos * way + idx;
+            return (bf[pos / 32] >> (pos % 32)) & 1;
+        });
     }
 
-    uint32_t query_multiway(uint64_t key)
+    uint32_t query_multiway(const Key & key) const
     {
         uint32_t ret = (1u << way) - 1;
-        for (int i = 0; i < k; ++i) {
-            uint64_t pos = BOB_hashs[i](&key) % bit_per_bf;
+        Hash h(key);
+        if (blocked) {
+            const uint32_t * block = bf + h.block(block_num) * 16;
+            for_probes<k>([&](auto i) {
+                uint32_t slot = h.template probe<decltype(i)::value>() % slot_per_block;
+                ret &= block[slot / slot_per_word] >> (slot % slot_per_word * way);
+                return ret != 0;
+            });
+            return ret;
+        }
+        for_probes<k>([&](auto i) {
+            uint64_t pos = h.template probe<decltype(i)::value>() % bit_per_bf;
             pos = pos * way;
 
             uint64_t item = (uint64_t(bf[pos / 32 + 1]) << 32) | bf[pos / 32];
             item >>= (pos % 32);
             ret &= item;
-            if (!ret) {
-                return 0;
-            }
-        }
+            return ret != 0;
+        });
 
         return ret;
     }
+
+    // query_batch takes the AVX2 path for uint64 keys in the unblocked layout, and falls back to query() otherwise
+#ifdef __AVX2__
+    static constexpr bool simd_batch = is_same<Key, uint64_t>::value && !blocked && num_bits < (1ull << 31);
+
+    // query_multiway of keys[0 .. 8), one key per lane; the gathers skip lanes that are already 0
+    __m256i query_multiway_x8(const uint64_t * keys) const
+    {
+        ProbeHash8<k, double_hashing> h(keys);
+        __m256i ret = _mm256_set1_epi32((1u << way) - 1);
+        for_probes<k>([&](auto i) {
+            __m256i pos = _mm256_mullo_epi32(simd_mod(h.template probe<decltype(i)::value>(), bit_per_bf),
+                                             _mm256_set1_epi32(way));
+            __m256i idx = _mm256_srli_epi32(pos, 5);
+            __m256i shift = _mm256_and_si256(pos, _mm256_set1_epi32(31));
+            __m256i live = simd_live(ret);
+            __m256i lo = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)bf, idx, live, 4);
+            __m256i hi = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)bf,
+                                                     _mm256_add_epi32(idx, _mm256_set1_epi32(1)), live, 4);
+            // shifting by 32 gives 0 in AVX2, so no special case for shift == 0
+            __m256i item = _mm256_or_si256(_mm256_srlv_epi32(lo, shift),
+                                           _mm256_sllv_epi32(hi, _mm256_sub_epi32(_mm256_set1_epi32(32), shift)));
+            ret = _mm256_and_si256(ret, item);
+            return !_mm256_testz_si256(ret, ret);
+        });
+        return ret;
+    }
+#else
+    static constexpr bool simd_batch = false;
+#endif
+
 public:
+    HUGE_PAGE_NEW
+
     MultiWayBloomFilter() {
         memset(bf, 0, sizeof(bf));
 
@@ -60,6 +131,15 @@ public:
             exit(-1);
         }
     }
+
+    // the filter words, as allocated with new
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.query_bytes = sizeof(bf);
+        m.overhead_bytes = huge_alloc_bytes(sizeof(*this)) - sizeof(bf);
+        return m;
+    }
 };
 
 #endif //COLORINGCLASSIFER_MULTI_WAY_BLOOM_FILTER_H
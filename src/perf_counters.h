@@ -0,0 +1,213 @@
+#ifndef COLORINGCLASSIFER_PERF_COUNTERS_H
+#define COLORINGCLASSIFER_PERF_COUNTERS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+using namespace std;
+
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,       // dTLB read misses
+    PERF_BRANCH_MISSES,
+    PERF_HW_EVENT_NUM,
+    // software events, the fallback when there is no PMU (most VMs)
+    PERF_TASK_CLOCK = PERF_HW_EVENT_NUM,   // ns on the cpu
+    PERF_PAGE_FAULTS,
+    PERF_CONTEXT_SWITCHES,
+    PERF_EVENT_NUM
+};
+
+static const char * const perf_event_names[PERF_EVENT_NUM] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses",
+    "task_clock_ns", "page_faults", "context_switches"
+};
+
+// counter values of one thread at a point in time, or the difference of two;
+// bit e of valid is set when event e could be counted
+struct PerfSample
+{
+    uint64_t values[PERF_EVENT_NUM];
+    uint32_t valid;
+
+    PerfSample() : valid(0)
+    {
+        memset(values, 0, sizeof(values));
+    }
+
+    bool has(PerfEvent e) const
+    {
+        return (valid >> e) & 1;
+    }
+
+    PerfSample operator-(const PerfSample & other) const
+    {
+        PerfSample d;
+        d.valid = valid & other.valid;
+        for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+            d.values[e] = values[e] - other.values[e];
+        }
+        return d;
+    }
+
+    // sums of deltas; the first one sets valid
+    PerfSample & operator+=(const PerfSample & delta)
+    {
+        valid = valid ? valid & delta.valid : delta.valid;
+        for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+            values[e] += delta.values[e];
+        }
+        return *this;
+    }
+
+    // the valid events as name=value / ops, e.g. per key or per query
+    void dump(FILE * f, double ops = 1) const
+    {
+        for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+            if (has(PerfEvent(e))) {
+                fprintf(f, " %s=%.3g", perf_event_names[e], values[e] / ops);
+            }
+        }
+    }
+
+    void write_json(FILE * f, double ops = 1) const
+    {
+        fprintf(f, "{");
+        bool first = true;
+        for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+            if (has(PerfEvent(e))) {
+                fprintf(f, "%s\"%s\": %.4g", first ? "" : ", ", perf_event_names[e], values[e] / ops);
+                first = false;
+            }
+        }
+        fprintf(f, "}");
+    }
+};
+
+// Free-running perf_event_open counters of the calling thread (user space only), read around a
+// batch of operations: PerfSample d = counters.read() - before.
+// Each event is opened on its own, so whatever the kernel allows is counted: the hardware events
+// need a PMU and perf_event_paranoid <= 2. If not even the software events can be opened
+// (perf_event_paranoid 3, seccomp), task clock, page faults and context switches come from
+// clock_gettime and getrusage instead. When the PMU multiplexes, values are scaled by
+// enabled / running time. A read is one syscall per open event, about 0.5 us each.
+class PerfCounters
+{
+    int fds[PERF_EVENT_NUM];
+    uint32_t open_mask;
+    bool use_rusage;
+
+    static int open_event(uint32_t type, uint64_t config)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    static uint64_t cache_config(uint64_t cache, uint64_t op, uint64_t result)
+    {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    PerfCounters() : open_mask(0), use_rusage(false)
+    {
+        static const uint32_t types[PERF_EVENT_NUM] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+            PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+        };
+        const uint64_t configs[PERF_EVENT_NUM] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+            cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),
+            PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES
+        };
+        for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+            fds[e] = open_event(types[e], configs[e]);
+            if (fds[e] >= 0) {
+                open_mask |= 1u << e;
+            }
+        }
+        use_rusage = (open_mask >> PERF_HW_EVENT_NUM) == 0;
+    }
+
+    static uint64_t rusage_value(PerfEvent e)
+    {
+        if (e == PERF_TASK_CLOCK) {
+            struct timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+        }
+        struct rusage ru;
+        getrusage(RUSAGE_THREAD, &ru);
+        return e == PERF_PAGE_FAULTS ? uint64_t(ru.ru_minflt + ru.ru_majflt) : uint64_t(ru.ru_nvcsw + ru.ru_nivcsw);
+    }
+
+public:
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters & operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters()
+    {
+        for (int fd: fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    // the counters of the calling thread, opened on first use
+    static PerfCounters & thread_counters()
+    {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+
+    bool hardware() const
+    {
+        return open_mask & ((1u << PERF_HW_EVENT_NUM) - 1);
+    }
+
+    // where the values come from, for the reports
+    const char * source() const
+    {
+        return hardware() ? "perf_event" : use_rusage ? "rusage" : "perf_event (software)";
+    }
+
+    PerfSample read() const
+    {
+        PerfSample s;
+        for (int e = 0; e < PERF_EVENT_NUM; ++e) {
+            if (fds[e] >= 0) {
+                // value, time enabled, time running
+                uint64_t buf[3];
+                if (::read(fds[e], buf, sizeof(buf)) != ssize_t(sizeof(buf))) {
+                    continue;
+                }
+                s.values[e] = buf[2] && buf[2] < buf[1] ? uint64_t(double(buf[0]) * buf[1] / buf[2]) : buf[0];
+                s.valid |= 1u << e;
+            } else if (use_rusage && e >= PERF_HW_EVENT_NUM) {
+                s.values[e] = rusage_value(PerfEvent(e));
+                s.valid |= 1u << e;
+            }
+        }
+        return s;
+    }
+};
+
+#endif //COLORINGCLASSIFER_PERF_COUNTERS_H
@@ -0,0 +1,49 @@
+#ifndef COLORINGCLASSIFER_QUERY_IMAGE_H
+#define COLORINGCLASSIFER_QUERY_IMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Query-only image of a classifier, laid out to be used in place through mmap:
+//   ImageHeader
+//   packed buckets at buckets_offset, aligned to IMAGE_ALIGN, in the ColorStorage<color_num> layout
+//   ImageOverflow<Key>[overflow_num] at overflow_offset, sorted by key_less<Key>
+// Bump IMAGE_VERSION whenever the layout changes.
+
+#define IMAGE_VERSION 3
+#define IMAGE_ALIGN 64
+
+static const char image_magic[8] = {'C', 'C', 'I', 'M', 'A', 'G', 'E', 0};
+
+struct ImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t color_num;
+    uint32_t bucket_num;
+    uint32_t offset_num;    // number of shifted lookups, log2(class num) for the shifting classifier
+    uint32_t seed1;
+    uint32_t seed2;
+    uint32_t key_size;
+    uint32_t reserved;
+    uint64_t buckets_offset;
+    uint64_t buckets_size;
+    uint64_t overflow_offset;
+    uint64_t overflow_num;
+    uint64_t file_size;
+};
+
+// padding bytes, if any, are written as zeros
+template<typename Key>
+struct ImageOverflow
+{
+    Key key;
+    uint32_t class_id;
+};
+
+inline uint64_t image_align(uint64_t offset, uint64_t align)
+{
+    return (offset + align - 1) / align * align;
+}
+
+#endif //COLORINGCLASSIFER_QUERY_IMAGE_H
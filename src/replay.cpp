@@ -0,0 +1,291 @@
+// Replays recorded key dumps against the engines, built as the `replay` target (-O3), replacing
+// the old test.cpp that read a fixed 11,000 keys from data/data_bytes.
+//
+//   replay [csv|json] [-c binary_class_num] [-b bits_per_key] <dir | file>...
+//
+// A directory is replayed file by file in name order, skipping what is not a dataset (see
+// dataset.h for the .dat/.bin and .txt/.csv formats). Per dataset every engine that fits the
+// class count builds on the distinct keys, the first occurrence deciding the class of a repeated
+// key, then queries the whole dump in file order straight from the mapping.
+// Reported per engine: keys in the dump, distinct keys, keys built, bits per built key (query
+// arrays and overflow table, and all of memory_usage() in total_bits_per_key),
+// build Mkeys/s, query ns/op over the dump and the error rate over the built keys.
+// The Bloom filters and XorRetrieval are sized at run time and take every key.
+// ShiftingColoringClassifier is sized at compile time: it gets the smallest tier in cc_tiers that
+// holds the keys, and builds on the first cc_tiers[last] keys of larger dumps.
+// Only the results go to stdout, the progress prints of the engines are sent to stderr.
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "dataset.h"
+#include "shift_coloring_classifier.h"
+#include "dynamic_bloom_filter.h"
+#include "xor_retrieval.h"
+
+using namespace std;
+
+constexpr int default_bits_per_key = 10;
+constexpr int bf_k = 7;
+// keys per template instance of the classifier, each one is a separate compile
+constexpr uint32_t cc_tiers[] = {1u << 16, 1u << 20};
+constexpr int cc_tier_num = sizeof(cc_tiers) / sizeof(cc_tiers[0]);
+
+struct ReplayResult
+{
+    string dataset;
+    string engine;
+    int class_num;
+    size_t keys;      // in the dump
+    size_t distinct;
+    size_t built;
+    bool build_ok;
+    double bits_per_key;
+    double total_bits_per_key;
+    double build_mkeys;
+    double query_ns;
+    double error_rate;
+};
+
+// the distinct keys of a dataset with their first class, what every engine builds on
+struct Replay
+{
+    const Dataset & ds;
+    KVList kvs;
+    // repeated keys whose classes differ, the later class is dropped
+    size_t conflicts;
+
+    explicit Replay(const Dataset & _ds) : ds(_ds), conflicts(0)
+    {
+        ds.append(kvs, 0, ds.size());
+        // stable: among equal keys the first in the file stays first
+        stable_sort(kvs.begin(), kvs.end(), [](const pair<uint64_t, uint32_t> & a,
+                                                const pair<uint64_t, uint32_t> & b) { return a.first < b.first; });
+        size_t n = 0;
+        for (size_t i = 0; i < kvs.size(); ++i) {
+            if (n && kvs[n - 1].first == kvs[i].first) {
+                conflicts += kvs[n - 1].second != kvs[i].second;
+                continue;
+            }
+            kvs[n++] = kvs[i];
+        }
+        kvs.resize(n);
+        kvs.shrink_to_fit();
+    }
+};
+
+template<typename Engine>
+ReplayResult run_engine(Engine * engine, Replay & r, size_t build_num)
+{
+    ReplayResult res;
+    res.dataset = r.ds.name();
+    res.engine = engine->name;
+    res.class_num = int(r.ds.get_class_num());
+    res.keys = r.ds.size();
+    res.distinct = r.kvs.size();
+    res.built = build_num;
+
+    auto t0 = chrono::steady_clock::now();
+    res.build_ok = engine->build(r.kvs, int(build_num));
+    auto t1 = chrono::steady_clock::now();
+    res.build_mkeys = build_num / chrono::duration<double, micro>(t1 - t0).count();
+    MemoryUsage mem = engine->memory_usage();
+    res.bits_per_key = 8.0 * mem.query_total() / build_num;
+    res.total_bits_per_key = 8.0 * mem.total() / build_num;
+
+    // one pass, a dump may not fit twice in the page cache
+    const uint64_t * keys = r.ds.keys();
+    volatile int sink = 0;
+    int acc = 0;
+    auto t2 = chrono::steady_clock::now();
+    for (size_t i = 0; i < r.ds.size(); ++i) {
+        acc += int(engine->query(keys[i]));
+    }
+    auto t3 = chrono::steady_clock::now();
+    sink = sink + acc;
+    res.query_ns = chrono::duration<double, nano>(t3 - t2).count() / r.ds.size();
+
+    size_t err_cnt = 0;
+    for (size_t i = 0; i < build_num; ++i) {
+        err_cnt += (int(engine->query(r.kvs[i].first)) != int(r.kvs[i].second));
+    }
+    res.error_rate = double(err_cnt) / build_num;
+    fprintf(stderr, "  %-14s %s\n", res.engine.c_str(), res.build_ok ? "ok" : "build failed");
+    return res;
+}
+
+template<uint32_t tier, uint32_t class_num>
+ReplayResult run_cc(Replay & r)
+{
+    constexpr uint32_t bucket_num = uint32_t(tier * 1.25) * log2(class_num);
+    auto e = new ShiftingColoringClassifier<bucket_num, 4, class_num>(41, 42);
+    ReplayResult res = run_engine(e, r, min<size_t>(r.kvs.size(), tier));
+    delete e;
+    return res;
+}
+
+template<uint32_t class_num>
+ReplayResult run_cc_tier(Replay & r)
+{
+    static_assert(cc_tier_num == 2, "one case per tier");
+    if (r.kvs.size() <= cc_tiers[0]) {
+        return run_cc<cc_tiers[0], class_num>(r);
+    }
+    return run_cc<cc_tiers[1], class_num>(r);
+}
+
+template<int class_num>
+ReplayResult run_xor(Replay & r)
+{
+    auto e = new XorRetrieval<class_num>(41);
+    ReplayResult res = run_engine(e, r, r.kvs.size());
+    delete e;
+    return res;
+}
+
+void replay_dataset(const Dataset & ds, int bits_per_key, vector<ReplayResult> & results)
+{
+    Replay r(ds);
+    uint32_t class_num = ds.get_class_num();
+    fprintf(stderr, "%s: %lu keys, %lu distinct, %lu class conflicts, %u classes\n", ds.name().c_str(),
+            (unsigned long)ds.size(), (unsigned long)r.kvs.size(), (unsigned long)r.conflicts, class_num);
+    if (r.kvs.empty()) {
+        return;
+    }
+    if (r.kvs.size() > size_t(INT_MAX)) {
+        fprintf(stderr, "  skipped, more than %d distinct keys\n", INT_MAX);
+        return;
+    }
+
+    size_t n = r.kvs.size();
+    uint64_t num_bits = uint64_t(bits_per_key) * n;
+    // the coded filter stores the class in binary, one way per bit
+    uint32_t coded_class_num = 2;
+    while (coded_class_num < class_num) {
+        coded_class_num *= 2;
+    }
+
+    if (class_num <= 32 && num_bits / class_num < (1ull << 32)) {
+        auto e = new DynamicMultiBloomFilter<>(num_bits, bf_k, int(class_num));
+        results.push_back(run_engine(e, r, n));
+        delete e;
+    } else {
+        fprintf(stderr, "  DynMultiBF     skipped, %u classes / %lu bits\n", class_num, (unsigned long)num_bits);
+    }
+    if (log2(coded_class_num) <= 32 && num_bits / log2(coded_class_num) < (1ull << 32)) {
+        auto e = new DynamicCodedBloomFilter<>(num_bits, bf_k, int(coded_class_num));
+        results.push_back(run_engine(e, r, n));
+        delete e;
+    } else {
+        fprintf(stderr, "  DynCodedBF     skipped, %u classes / %lu bits\n", class_num, (unsigned long)num_bits);
+    }
+    if (class_num <= 64 && num_bits < (1ull << 32)) {
+        auto e = new DynamicShiftingBloomFilter<>(num_bits, bf_k, int(class_num));
+        results.push_back(run_engine(e, r, n));
+        delete e;
+    } else {
+        fprintf(stderr, "  DynShiftBF     skipped, %u classes / %lu bits\n", class_num, (unsigned long)num_bits);
+    }
+
+    if (class_num <= 2) {
+        results.push_back(run_xor<2>(r));
+    } else if (class_num <= 4) {
+        results.push_back(run_xor<4>(r));
+    } else if (class_num <= 256) {
+        results.push_back(run_xor<256>(r));
+    } else {
+        results.push_back(run_xor<65536>(r));
+    }
+
+    if (class_num <= 2) {
+        results.push_back(run_cc_tier<2>(r));
+    } else if (class_num <= 4) {
+        results.push_back(run_cc_tier<4>(r));
+    } else {
+        fprintf(stderr, "  CC4            skipped, more than 4 classes\n");
+    }
+}
+
+void print_csv(const vector<ReplayResult> & results)
+{
+    printf("dataset,engine,class_num,keys,distinct,built,build_ok,bits_per_key,total_bits_per_key,build_mkeys_per_s,"
+           "query_ns,error_rate\n");
+    for (auto & r: results) {
+        printf("%s,%s,%d,%lu,%lu,%lu,%d,%.3f,%.3f,%.3f,%.2f,%.6f\n", r.dataset.c_str(), r.engine.c_str(), r.class_num,
+               (unsigned long)r.keys, (unsigned long)r.distinct, (unsigned long)r.built, int(r.build_ok),
+               r.bits_per_key, r.total_bits_per_key, r.build_mkeys, r.query_ns, r.error_rate);
+    }
+}
+
+void print_json(const vector<ReplayResult> & results)
+{
+    printf("[\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto & r = results[i];
+        printf("  {\"dataset\": \"%s\", \"engine\": \"%s\", \"class_num\": %d, \"keys\": %lu, \"distinct\": %lu, "
+               "\"built\": %lu, \"build_ok\": %s, \"bits_per_key\": %.3f, \"total_bits_per_key\": %.3f, "
+               "\"build_mkeys_per_s\": %.3f, "
+               "\"query_ns\": %.2f, \"error_rate\": %.6f}%s\n", r.dataset.c_str(), r.engine.c_str(), r.class_num,
+               (unsigned long)r.keys, (unsigned long)r.distinct, (unsigned long)r.built,
+               r.build_ok ? "true" : "false", r.bits_per_key, r.total_bits_per_key, r.build_mkeys, r.query_ns, r.error_rate,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("]\n");
+}
+
+int main(int argc, char ** argv)
+{
+    bool json = false;
+    int binary_class_num = 2;
+    int bits_per_key = default_bits_per_key;
+    vector<string> files;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "csv") == 0) {
+            json = false;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            binary_class_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            bits_per_key = atoi(argv[++i]);
+        } else if (filesystem::is_directory(argv[i])) {
+            vector<string> dir_files;
+            for (auto & entry: filesystem::directory_iterator(argv[i])) {
+                if (entry.is_regular_file() && Dataset::format_of(entry.path().string()) != Dataset::UNKNOWN) {
+                    dir_files.push_back(entry.path().string());
+                }
+            }
+            sort(dir_files.begin(), dir_files.end());
+            files.insert(files.end(), dir_files.begin(), dir_files.end());
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty() || binary_class_num < 1 || bits_per_key < 1) {
+        fprintf(stderr, "usage: %s [csv|json] [-c binary_class_num] [-b bits_per_key] <dir | file>...\n", argv[0]);
+        return 1;
+    }
+
+    cout.rdbuf(cerr.rdbuf());
+    vector<ReplayResult> results;
+    for (auto & file: files) {
+        Dataset ds;
+        if (!ds.open(file, uint32_t(binary_class_num))) {
+            continue;
+        }
+        replay_dataset(ds, bits_per_key, results);
+    }
+
+    if (json) {
+        print_json(results);
+    } else {
+        print_csv(results);
+    }
+    return 0;
+}
@@ -0,0 +1,585 @@
+// Classification sidecar for processes that do not link C++, built as the `server` target (-O3).
+//
+//   server [-l endpoint] [-w workers] [-e cc|xor] [-s snapshot_out] <image | snapshot | dataset | -g keys[:classes]>
+//
+// Serves batched classify requests (see classify_protocol.h) on a Unix domain socket or loopback
+// TCP, endpoint as in Endpoint::parse, default unix:/tmp/cc_classify.sock. What it serves:
+//   image              a query image written by save_image(), mapped by MappedColoringClassifier
+//   snapshot           a snapshot written by save() (snapshot.h) of a ShiftingColoringClassifier
+//                      of one of the sizes below, loaded at start up
+//   dataset            a .dat/.bin/.txt/.csv key dump (see dataset.h), built at start up on its
+//                      distinct keys, the first class of a repeated key wins
+//   -g keys[:classes]  built on the keys of workload.h with the default seed and class i % classes,
+//                      what `client -g` sends and checks
+// Images and snapshots are told from dumps by their magic.
+// A dataset or -g builds the engine of -e: cc (default), a ShiftingColoringClassifier sized for the
+// smallest tier in cc_tiers that holds the keys, for up to 4 classes; or xor, XorRetrieval, sized
+// at run time for any key and class count. Neither knows non-members, they get some class.
+// -s saves the snapshot of a classifier built by -e cc, to be served again without the build.
+// The main thread accepts and hands each connection to one of `workers` threads (default: the
+// cores), each with its own epoll set, so a connection is only ever touched by one thread and
+// the engine is shared read-only through its const query(). Keys are classified in place in the
+// receive buffer of the connection and the answers written to its send buffer, which are reused
+// for every request. A connection is read from while its answers not yet taken by the socket
+// stay below max_backlog_bytes: a pipelining client is served while it sends, and one that does
+// not read its responses is slowed down, not buffered without bound.
+// SIGINT / SIGTERM stop the server and print the totals to stderr.
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <csignal>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <sys/epoll.h>
+#include "classify_protocol.h"
+#include "mapped_coloring_classifier.h"
+#include "shift_coloring_classifier.h"
+#include "xor_retrieval.h"
+#include "dataset.h"
+#include "workload.h"
+
+using namespace std;
+
+// a receive buffer starts this large and grows to the largest request seen
+constexpr size_t initial_buffer_bytes = 64 << 10;
+// keys per template instance of the classifier, each one is a separate compile; as in replay
+constexpr uint32_t cc_tiers[] = {1u << 16, 1u << 20};
+
+// answers a connection may have waiting for the socket before it is no longer read from,
+// a few of the largest responses
+constexpr size_t max_backlog_bytes = 1 << 20;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int)
+{
+    stop_requested = 1;
+}
+
+struct Connection
+{
+    int fd;
+    // uint64 storage keeps the keys of every request 8-byte aligned: requests are 8 + 8 * count
+    // bytes and the buffer is compacted to its start
+    vector<uint64_t> in;
+    size_t in_len;      // bytes
+    vector<char> out;
+    size_t out_pos, out_len;
+    bool want_write;
+
+    explicit Connection(int _fd) : fd(_fd), in(initial_buffer_bytes / sizeof(uint64_t)), in_len(0),
+                                   out(initial_buffer_bytes), out_pos(0), out_len(0), want_write(false)
+    {
+    }
+
+    char * in_bytes()
+    {
+        return (char *)in.data();
+    }
+
+    // answers waiting for the socket
+    size_t backlog() const
+    {
+        return out_len - out_pos;
+    }
+
+    bool can_read() const
+    {
+        return backlog() < max_backlog_bytes;
+    }
+
+    size_t in_capacity() const
+    {
+        return in.size() * sizeof(uint64_t);
+    }
+};
+
+template<typename Engine>
+class Worker
+{
+    const Engine & engine;
+    int epfd;
+
+public:
+    atomic<uint64_t> requests, keys, connections;
+
+    explicit Worker(const Engine & _engine) : engine(_engine), epfd(epoll_create1(EPOLL_CLOEXEC)),
+                                              requests(0), keys(0), connections(0)
+    {
+    }
+
+    ~Worker()
+    {
+        close(epfd);
+    }
+
+    // from the accepting thread; epoll_ctl is safe against a concurrent epoll_wait
+    bool add(Connection * conn)
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, conn->fd, &ev) != 0) {
+            return false;
+        }
+        connections.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    void run()
+    {
+        epoll_event events[64];
+        while (!stop_requested) {
+            int n = epoll_wait(epfd, events, 64, 100);
+            for (int i = 0; i < n; ++i) {
+                Connection * conn = (Connection *)events[i].data.ptr;
+                bool ok = true;
+                if (events[i].events & EPOLLOUT) {
+                    ok = flush(conn);
+                }
+                if (ok && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && conn->can_read()) {
+                    ok = read_requests(conn);
+                }
+                if (ok) {
+                    ok = update_events(conn);
+                }
+                if (!ok) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                    close(conn->fd);
+                    delete conn;
+                }
+            }
+        }
+    }
+
+private:
+    // reads while the socket has data and the backlog is small, false when the connection is done
+    bool read_requests(Connection * conn)
+    {
+        while (conn->can_read()) {
+            if (conn->in_len == conn->in_capacity()) {
+                // only a request larger than the buffer fills it, process() leaves less than one
+                conn->in.resize(conn->in.size() * 2);
+            }
+            ssize_t n = recv(conn->fd, conn->in_bytes() + conn->in_len, conn->in_capacity() - conn->in_len, 0);
+            if (n == 0) {
+                return false;
+            }
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            conn->in_len += size_t(n);
+            if (!process(conn) || !flush(conn)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // answers the complete requests in the receive buffer, false on a malformed one
+    bool process(Connection * conn)
+    {
+        size_t pos = 0;
+        uint64_t request_num = 0, key_num = 0;
+        while (conn->in_len - pos >= sizeof(ClassifyHeader)) {
+            const ClassifyHeader * req = (const ClassifyHeader *)(conn->in_bytes() + pos);
+            if (req->magic != CLASSIFY_REQUEST || req->count > CLASSIFY_MAX_BATCH) {
+                fprintf(stderr, "Bad request on fd %d, closing\n", conn->fd);
+                return false;
+            }
+            uint32_t count = req->count;
+            if (conn->in_len - pos < classify_request_bytes(count)) {
+                // grow now so the rest of the request fits in one go
+                size_t need = classify_request_bytes(count);
+                if (need > conn->in_capacity()) {
+                    conn->in.resize((need + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+                }
+                break;
+            }
+
+            if (conn->out.size() < conn->out_len + classify_response_bytes(count)) {
+                conn->out.resize(max(conn->out.size() * 2, conn->out_len + classify_response_bytes(count)));
+            }
+            char * out = conn->out.data() + conn->out_len;
+            ClassifyHeader resp = {CLASSIFY_RESPONSE, count};
+            memcpy(out, &resp, sizeof(resp));
+            const uint64_t * req_keys = (const uint64_t *)(conn->in_bytes() + pos + sizeof(ClassifyHeader));
+            int32_t * classes = (int32_t *)(out + sizeof(ClassifyHeader));
+            for (uint32_t i = 0; i < count; ++i) {
+                classes[i] = int32_t(engine.query(req_keys[i]));
+            }
+            conn->out_len += classify_response_bytes(count);
+            pos += classify_request_bytes(count);
+            request_num++;
+            key_num += count;
+        }
+        if (pos) {
+            memmove(conn->in_bytes(), conn->in_bytes() + pos, conn->in_len - pos);
+            conn->in_len -= pos;
+        }
+        requests.fetch_add(request_num, memory_order_relaxed);
+        keys.fetch_add(key_num, memory_order_relaxed);
+        return true;
+    }
+
+    // sends what the socket takes; want_write is left set while answers are pending,
+    // which are moved to the start of the buffer so new answers go after them
+    bool flush(Connection * conn)
+    {
+        while (conn->out_pos < conn->out_len) {
+            ssize_t n = send(conn->fd, conn->out.data() + conn->out_pos, conn->out_len - conn->out_pos, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    memmove(conn->out.data(), conn->out.data() + conn->out_pos, conn->backlog());
+                    conn->out_len -= conn->out_pos;
+                    conn->out_pos = 0;
+                    conn->want_write = true;
+                    return true;
+                }
+                return false;
+            }
+            conn->out_pos += size_t(n);
+        }
+        conn->out_pos = conn->out_len = 0;
+        conn->want_write = false;
+        return true;
+    }
+
+    // level triggered: wait for the socket to drain while answers are pending, and for requests
+    // while the backlog is small
+    bool update_events(Connection * conn)
+    {
+        epoll_event ev;
+        ev.events = (conn->want_write ? uint32_t(EPOLLOUT) : 0u) | (conn->can_read() ? uint32_t(EPOLLIN | EPOLLRDHUP) : 0u);
+        ev.data.ptr = conn;
+        return epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev) == 0;
+    }
+};
+
+template<typename Engine>
+int serve(const Engine & engine, const Endpoint & ep, int worker_num)
+{
+    int listen_fd = listen_endpoint(ep);
+    if (listen_fd < 0) {
+        return 1;
+    }
+    signal(SIGINT, on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<Worker<Engine> *> workers;
+    vector<thread> threads;
+    for (int w = 0; w < worker_num; ++w) {
+        workers.push_back(new Worker<Engine>(engine));
+    }
+    for (int w = 0; w < worker_num; ++w) {
+        threads.push_back(thread([&, w] { workers[w]->run(); }));
+    }
+    fprintf(stderr, "Serving %s on %s with %d workers\n", engine.name.c_str(), ep.str().c_str(), worker_num);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    auto t0 = chrono::steady_clock::now();
+    int next = 0;
+    while (!stop_requested) {
+        if (epoll_wait(epfd, &ev, 1, 100) <= 0) {
+            continue;
+        }
+        while (true) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                break;
+            }
+            if (!ep.unix_socket) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            Connection * conn = new Connection(fd);
+            if (!workers[next]->add(conn)) {
+                close(fd);
+                delete conn;
+            }
+            next = (next + 1) % worker_num;
+        }
+    }
+    for (auto & th: threads) {
+        th.join();
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    uint64_t requests = 0, keys = 0, connections = 0;
+    for (auto w: workers) {
+        requests += w->requests;
+        keys += w->keys;
+        connections += w->connections;
+        delete w;
+    }
+    fprintf(stderr, "%lu connections, %lu requests, %lu keys in %.1f s\n", (unsigned long)connections,
+            (unsigned long)requests, (unsigned long)keys, secs);
+    close(epfd);
+    close(listen_fd);
+    if (ep.unix_socket) {
+        unlink(ep.path.c_str());
+    }
+    return 0;
+}
+
+template<int class_num>
+int serve_retrieval(KVList & kvs, const Endpoint & ep, int worker_num)
+{
+    auto e = new XorRetrieval<class_num>(41);
+    if (!e->build(kvs, int(kvs.size()))) {
+        delete e;
+        return 1;
+    }
+    fprintf(stderr, "Built %s on %lu keys, %.2f bits/key\n", e->name.c_str(), (unsigned long)kvs.size(),
+            8.0 * e->memory_usage().query_total() / kvs.size());
+    KVList().swap(kvs);
+    int ret = serve(*e, ep, worker_num);
+    delete e;
+    return ret;
+}
+
+// where a classifier comes from: built on kvs, or loaded from snapshot; saved to save_path if set
+struct ClassifierSource
+{
+    KVList * kvs;
+    const char * snapshot;
+    const char * save_path;
+};
+
+template<uint32_t tier, uint32_t class_num>
+constexpr uint32_t cc_bucket_num()
+{
+    return uint32_t(tier * 1.25) * log2(class_num);
+}
+
+template<uint32_t tier, uint32_t class_num>
+int serve_cc(ClassifierSource & src, const Endpoint & ep, int worker_num)
+{
+    auto e = new ShiftingColoringClassifier<cc_bucket_num<tier, class_num>(), 4, class_num>(41, 42);
+    bool ok;
+    if (src.snapshot) {
+        ok = e->load(src.snapshot);
+        if (ok) {
+            fprintf(stderr, "Loaded %s with %u buckets and %d classes from %s\n", e->name.c_str(),
+                    cc_bucket_num<tier, class_num>(), int(class_num), src.snapshot);
+        }
+    } else {
+        ok = e->build(*src.kvs, int(src.kvs->size()));
+        if (ok) {
+            fprintf(stderr, "Built %s on %lu keys, %u buckets, overflow table %d\n", e->name.c_str(),
+                    (unsigned long)src.kvs->size(), cc_bucket_num<tier, class_num>(), e->OverFlowTable.size());
+        } else {
+            fprintf(stderr, "Building %s on %lu keys failed\n", e->name.c_str(), (unsigned long)src.kvs->size());
+        }
+        KVList().swap(*src.kvs);
+    }
+    if (ok && src.save_path) {
+        ok = e->save(src.save_path);
+        fprintf(stderr, "%s snapshot %s\n", ok ? "Saved" : "Cannot save", src.save_path);
+    }
+    int ret = ok ? serve(*e, ep, worker_num) : 1;
+    delete e;
+    return ret;
+}
+
+// calls f(tier, class_num) as integral_constants for every classifier the server has, until it returns true
+template<typename F>
+bool for_cc_config(F f)
+{
+    static_assert(sizeof(cc_tiers) / sizeof(cc_tiers[0]) == 2, "one case per tier");
+    typedef integral_constant<uint32_t, 2> two;
+    typedef integral_constant<uint32_t, 4> four;
+    typedef integral_constant<uint32_t, cc_tiers[0]> small;
+    typedef integral_constant<uint32_t, cc_tiers[1]> large;
+    return f(small(), two()) || f(large(), two()) || f(small(), four()) || f(large(), four());
+}
+
+int serve_kvs(KVList & kvs, uint32_t class_num, bool use_cc, const char * save_path, const Endpoint & ep,
+              int worker_num)
+{
+    if (kvs.empty() || kvs.size() > size_t(INT_MAX)) {
+        fprintf(stderr, "Cannot build on %lu keys\n", (unsigned long)kvs.size());
+        return 1;
+    }
+    if (use_cc) {
+        ClassifierSource src = {&kvs, NULL, save_path};
+        int ret = -1;
+        for_cc_config([&](auto tier, auto classes) {
+            if (kvs.size() > decltype(tier)::value || class_num > decltype(classes)::value) {
+                return false;
+            }
+            ret = serve_cc<decltype(tier)::value, decltype(classes)::value>(src, ep, worker_num);
+            return true;
+        });
+        if (ret == -1) {
+            fprintf(stderr, "The classifier takes up to %u keys of up to 4 classes, not %lu of %u, see -e xor\n",
+                    cc_tiers[1], (unsigned long)kvs.size(), class_num);
+            return 1;
+        }
+        return ret;
+    }
+    if (save_path) {
+        fprintf(stderr, "-s saves a classifier snapshot, it needs -e cc\n");
+        return 1;
+    }
+    if (class_num <= 2) {
+        return serve_retrieval<2>(kvs, ep, worker_num);
+    }
+    if (class_num <= 4) {
+        return serve_retrieval<4>(kvs, ep, worker_num);
+    }
+    if (class_num <= 256) {
+        return serve_retrieval<256>(kvs, ep, worker_num);
+    }
+    return serve_retrieval<65536>(kvs, ep, worker_num);
+}
+
+// the classifier whose bucket count the snapshot has
+int serve_snapshot(const string & path, const char * save_path, const Endpoint & ep, int worker_num)
+{
+    SnapshotHeader header;
+    FILE * f = fopen(path.c_str(), "rb");
+    bool read = f && fread(&header, sizeof(header), 1, f) == 1;
+    if (f) {
+        fclose(f);
+    }
+    if (!read) {
+        fprintf(stderr, "Cannot read %s\n", path.c_str());
+        return 1;
+    }
+    ClassifierSource src = {NULL, path.c_str(), save_path};
+    int ret = -1;
+    for_cc_config([&](auto tier, auto classes) {
+        if (uint32_t(header.bucket_num) != cc_bucket_num<decltype(tier)::value, decltype(classes)::value>()) {
+            return false;
+        }
+        ret = serve_cc<decltype(tier)::value, decltype(classes)::value>(src, ep, worker_num);
+        return true;
+    });
+    if (ret == -1) {
+        fprintf(stderr, "Snapshot %s has %d buckets, the server has classifiers of", path.c_str(), header.bucket_num);
+        for_cc_config([&](auto tier, auto classes) {
+            fprintf(stderr, " %u", cc_bucket_num<decltype(tier)::value, decltype(classes)::value>());
+            return false;
+        });
+        fprintf(stderr, " buckets; write it with server -s\n");
+        return 1;
+    }
+    return ret;
+}
+
+// the distinct keys of a dump with their first class
+bool load_dataset(const string & path, KVList & kvs, uint32_t & class_num)
+{
+    Dataset ds;
+    if (!ds.open(path)) {
+        return false;
+    }
+    ds.append(kvs, 0, ds.size());
+    class_num = ds.get_class_num();
+    stable_sort(kvs.begin(), kvs.end(), [](const pair<uint64_t, uint32_t> & a,
+                                            const pair<uint64_t, uint32_t> & b) { return a.first < b.first; });
+    kvs.erase(unique(kvs.begin(), kvs.end(), [](const pair<uint64_t, uint32_t> & a,
+                                                const pair<uint64_t, uint32_t> & b) { return a.first == b.first; }),
+              kvs.end());
+    return true;
+}
+
+// images and snapshots are told by their magic, the default name of `demo mapped` ends in .bin like a dump
+bool has_magic(const string & path, const char (&magic)[8])
+{
+    char head[sizeof(magic)];
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    bool ret = fread(head, 1, sizeof(head), f) == sizeof(head) && memcmp(head, magic, sizeof(head)) == 0;
+    fclose(f);
+    return ret;
+}
+
+int main(int argc, char ** argv)
+{
+    Endpoint ep;
+    int worker_num = max(int(thread::hardware_concurrency()), 1);
+    string source;
+    bool use_cc = true;
+    const char * save_path = NULL;
+    uint64_t gen_num = 0;
+    uint32_t gen_class_num = 2;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            if (!ep.parse(argv[++i])) {
+                fprintf(stderr, "Bad endpoint %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            worker_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            use_cc = strcmp(argv[++i], "xor") != 0;
+            if (use_cc && strcmp(argv[i], "cc") != 0) {
+                fprintf(stderr, "Unknown engine %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            const char * spec = argv[++i];
+            gen_num = strtoull(spec, NULL, 10);
+            const char * colon = strchr(spec, ':');
+            if (colon) {
+                gen_class_num = uint32_t(atoi(colon + 1));
+            }
+        } else {
+            source = argv[i];
+        }
+    }
+    if ((source.empty() == !gen_num) || worker_num < 1 || gen_class_num < 1) {
+        fprintf(stderr, "usage: %s [-l unix:PATH | tcp:[HOST:]PORT] [-w workers] [-e cc|xor] [-s snapshot_out] "
+                "<image | snapshot | dataset | -g keys[:classes]>\n", argv[0]);
+        return 1;
+    }
+    // the engines print build progress, only the server log goes to stderr
+    cout.rdbuf(cerr.rdbuf());
+
+    if (gen_num) {
+        WorkloadSpec spec;
+        spec.class_num = gen_class_num;
+        KVList kvs = WorkloadGenerator(spec).kvs(gen_num);
+        return serve_kvs(kvs, gen_class_num, use_cc, save_path, ep, worker_num);
+    }
+    if (has_magic(source, snapshot_magic)) {
+        return serve_snapshot(source, save_path, ep, worker_num);
+    }
+    if (!has_magic(source, image_magic) && Dataset::format_of(source) != Dataset::UNKNOWN) {
+        KVList kvs;
+        uint32_t class_num;
+        if (!load_dataset(source, kvs, class_num)) {
+            return 1;
+        }
+        return serve_kvs(kvs, class_num, use_cc, save_path, ep, worker_num);
+    }
+    if (save_path) {
+        fprintf(stderr, "An image has no snapshot to save\n");
+        return 1;
+    }
+    MappedColoringClassifier<4> mapped;
+    if (!mapped.open(source.c_str())) {
+        return 1;
+    }
+    return serve(mapped, ep, worker_num);
+}
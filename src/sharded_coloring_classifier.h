@@ -0,0 +1,184 @@
+#ifndef COLORINGCLASSIFER_SHARDED_COLORING_CLASSIFIER_H
+#define COLORINGCLASSIFER_SHARDED_COLORING_CLASSIFIER_H
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <random>
+#include "shift_coloring_classifier.h"
+#include "utils.h"
+
+using namespace std;
+
+// Split the keyspace over shard_num independent embedders.
+// A key is routed by the top bits of a separate hash, so a query pays one extra hash and shift.
+// shard_bucket_num should be chosen so that the bucket array of one shard fits in L2/L3,
+// and with some slack over (key num / shard_num) since shards are not loaded evenly.
+template<uint32_t shard_bucket_num, uint32_t shard_num, uint32_t color_num = 4, uint32_t class_num = 2,
+         typename Key = uint64_t>
+class ShardedColoringClassifier
+{
+    static_assert(shard_num >= 2 && (shard_num & (shard_num - 1)) == 0, "shard_num must be a power of 2");
+    static constexpr int shard_shift = 32 - log2(shard_num);
+
+    typedef ShiftingColoringClassifier<shard_bucket_num, color_num, class_num, Key> Shard;
+
+    BOBHash route_hash;
+    mt19937 rng;
+    Shard * shards[shard_num];
+    // keys of each shard are retained so that one shard can be rebuilt alone
+    KeyValueList<Key> shard_kvs[shard_num];
+    uint32_t shard_seeds[shard_num];
+
+    bool build_shard(uint32_t i)
+    {
+        mt19937 gen(shard_seeds[i]);
+        for (int retry = 0; retry < max_retry; ++retry) {
+            delete shards[i];
+            shards[i] = new Shard(uint32_t(gen()), uint32_t(gen()));
+            if (shards[i]->build(shard_kvs[i], int(shard_kvs[i].size()))) {
+                shard_seeds[i] = uint32_t(gen());
+                return true;
+            }
+            rebuild_times[i] += 1;
+        }
+        shard_seeds[i] = uint32_t(gen());
+        return false;
+    }
+
+public:
+    string name;
+    constexpr static int _class_num = class_num;
+    int max_retry = 8;
+    int thread_num;
+    int rebuild_times[shard_num];
+
+    ShardedColoringClassifier() : route_hash(0), rng(random_device()())
+    {
+        init(uint32_t(rng()));
+    }
+
+    explicit ShardedColoringClassifier(uint32_t seed) : route_hash(0), rng(seed)
+    {
+        init(uint32_t(rng()));
+    }
+
+    void init(uint32_t route_seed)
+    {
+        name = "ShardedCC" + string(1, char('0' + color_num));
+        route_hash = BOBHash(route_seed);
+        thread_num = max(1u, thread::hardware_concurrency());
+        for (uint32_t i = 0; i < shard_num; ++i) {
+            shards[i] = NULL;
+            shard_seeds[i] = uint32_t(rng());
+            rebuild_times[i] = 0;
+        }
+    }
+
+    inline uint32_t shard_of(const Key & key) const
+    {
+        return route_hash.run<sizeof(Key)>(&key) >> shard_shift;
+    }
+
+    // each shard is built on its own thread, and a shard that fails is retried
+    // with new seeds without touching the others; a second build replaces the keys of the first
+    bool build(KeyValueList<Key> & kvs, int num)
+    {
+        for (uint32_t i = 0; i < shard_num; ++i) {
+            shard_kvs[i].clear();
+        }
+        for (int i = 0; i < num; ++i) {
+            shard_kvs[shard_of(kvs[i].first)].push_back(kvs[i]);
+        }
+
+        atomic<uint32_t> next(0);
+        atomic<int> failed(0);
+        vector<thread> workers;
+        for (int t = 0; t < min(thread_num, int(shard_num)); ++t) {
+            workers.push_back(thread([&] {
+                for (uint32_t i = next++; i < shard_num; i = next++) {
+                    if (!build_shard(i)) {
+                        failed++;
+                    }
+                }
+            }));
+        }
+        for (auto & w: workers) {
+            w.join();
+        }
+
+        return failed == 0;
+    }
+
+    // rebuild a single shard from its retained keys, e.g. after its overflow table grew
+    bool rebuild_shard(uint32_t i)
+    {
+        return build_shard(i);
+    }
+
+    // before the first build, the shard of the key is built from the keys inserted so far
+    bool insert(const Key & key, int class_id)
+    {
+        uint32_t i = shard_of(key);
+        shard_kvs[i].push_back(make_pair(key, uint32_t(class_id)));
+        if (!shards[i]) {
+            return build_shard(i);
+        }
+        return shards[i]->insert(key, class_id);
+    }
+
+    // a shard that was never built has no members, its keys get class 0 like any non-member may
+    uint32_t query(const Key & key) const
+    {
+        const Shard * shard = shards[shard_of(key)];
+        return shard ? shard->query(key) : 0;
+    }
+
+    const Shard * get_shard(uint32_t i) const
+    {
+        return shards[i];
+    }
+
+    int overflow_size() const
+    {
+        int ret = 0;
+        for (uint32_t i = 0; i < shard_num; ++i) {
+            ret += shards[i] ? shards[i]->OverFlowTable.size() : 0;
+        }
+        return ret;
+    }
+
+    // the shards, plus their retained keys as build state
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.build_bytes = sizeof(*this);
+        for (uint32_t i = 0; i < shard_num; ++i) {
+            if (shards[i]) {
+                m += shards[i]->memory_usage();
+            }
+            add_vector_usage(m, &MemoryUsage::build_bytes, shard_kvs[i]);
+        }
+        return m;
+    }
+
+    void report()
+    {
+        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n"
+            "report sharded coloring result...\n");
+        for (uint32_t i = 0; i < shard_num; ++i) {
+            printf("\tshard %u: %d keys, %d rebuilds, overflow table size %d\n", i,
+                   int(shard_kvs[i].size()), rebuild_times[i], shards[i] ? shards[i]->OverFlowTable.size() : 0);
+        }
+        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    }
+
+    ~ShardedColoringClassifier()
+    {
+        for (uint32_t i = 0; i < shard_num; ++i) {
+            delete shards[i];
+        }
+    }
+};
+
+#endif //COLORINGCLASSIFER_SHARDED_COLORING_CLASSIFIER_H
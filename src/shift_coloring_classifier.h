@@ -8,10 +8,10 @@
 using namespace std;
 
 // 这里我把shift_cc改成public继承了
-template<uint32_t bucket_num, uint32_t color_num, uint32_t class_num>
-class ShiftingColoringClassifier: public ColoringClassifier<bucket_num, color_num>
+template<uint32_t bucket_num, uint32_t color_num, uint32_t class_num, typename Key = uint64_t>
+class ShiftingColoringClassifier: public ColoringClassifier<bucket_num, color_num, 0, Key>
 {
-    typedef ColoringClassifier<bucket_num, color_num> Parent;
+    typedef ColoringClassifier<bucket_num, color_num, 0, Key> Parent;
     static constexpr int max_offset = log2(class_num);
 public:
     string name;
@@ -21,7 +21,13 @@ public:
         name = "CC" + string(1, char('0' + color_num));
     }
 
-    bool build(vector<pair<uint64_t, uint32_t>> & kvs, int data_num)
+    ShiftingColoringClassifier(uint32_t seed1, uint32_t seed2) : Parent(seed1, seed2) {
+        name = "CC" + string(1, char('0' + color_num));
+    }
+
+    // T is Key, or string_view (StrKVList) when Key is uint64_t, str keys are not copied
+    template<typename T>
+    bool build(vector<pair<T, uint32_t>> & kvs, int data_num)
     {
         int counters[class_num][2];
         memset(counters, 0, sizeof(counters));
@@ -39,44 +45,70 @@ public:
 //        }
 //
 //        cout << "try insert..." << endl;
-        for (int i = 0; i < data_num; ++i) {
-            uint64_t key = kvs[i].first;
-            uint32_t val = kvs[i].second;
+        {
+            PhaseTimer timer(Parent::build_profile, PHASE_HASHING);
+            for (int i = 0; i < data_num; ++i) {
+                const T & key = kvs[i].first;
+                uint32_t val = kvs[i].second;
 
-            typename Parent::CCEdge e(key);
+                typename Parent::CCEdge e(key, Parent::hash1, Parent::hash2);
 
-            for (int k = 0; k < max_offset; ++k) {
-                if ((val >> k) & 1) {
-                    Parent::pos_edges.push_back(new typename Parent::CCEdge(e, k));
-                }
-                else {
-                    Parent::neg_edges.push_back(new typename Parent::CCEdge(e, k));
+                for (int k = 0; k < max_offset; ++k) {
+                    if ((val >> k) & 1) {
+                        Parent::pos_edges.push_back(new typename Parent::CCEdge(e, k));
+                    }
+                    else {
+                        Parent::neg_edges.push_back(new typename Parent::CCEdge(e, k));
+                    }
                 }
             }
         }
-        bool flag = ColoringClassifier<bucket_num, color_num>::build();
+        bool flag = Parent::build();
         return flag;
     }
 
-    uint32_t query(uint64_t key)
+private:
+    uint32_t query_buckets(uint32_t a, uint32_t b) const
     {
-        typename Parent::CCEdge e(key);
-
         uint32_t ret = 0;
+        for (int k = 0; k < max_offset; ++k) {
+            int c1 = Parent::get_bucket_val((a + k) % bucket_num);
+            int c2 = Parent::get_bucket_val((b + k) % bucket_num);
+            ret |= ((c1 == c2 ? 0 : 1u) << k);
+        }
+        return ret;
+    }
 
+public:
+    uint32_t query(const Key & key) const
+    {
         // Check if the element exists in the OverFlowTable
         int query = Parent::OverFlowTable.query(key);
         if(query != -1){
             return query;
         }
 
-        for (int k = 0; k < max_offset; ++k) {
-            int c1 = Parent::get_bucket_val((e.hash_val_a + k) % bucket_num);
-            int c2 = Parent::get_bucket_val((e.hash_val_b + k) % bucket_num);
-            ret |= ((c1 == c2 ? 0 : 1u) << k);
+        uint32_t a, b;
+        cc_hash_pair(key, Parent::hash1, Parent::hash2, bucket_num, a, b);
+        return query_buckets(a, b);
+    }
+
+    // one hash pass over the string, its fingerprint is the OverFlowTable key
+    uint32_t query(string_view key) const
+    {
+        uint32_t a, b;
+        uint64_t fingerprint = cc_hash_pair(key, Parent::hash1, Parent::hash2, bucket_num, a, b);
+
+        int query = Parent::OverFlowTable.query(fingerprint);
+        if(query != -1){
+            return query;
         }
+        return query_buckets(a, b);
+    }
 
-        return ret;
+    bool save_image(const char * path) const
+    {
+        return Parent::save_image(path, max_offset);
     }
 };
 
@@ -2,67 +2,142 @@
 #define COLORINGCLASSIFER_SHIFT_BLOOM_FILTER_H
 
 #include "BOB_hash.h"
-
-template<int num_bits, int k, int class_num = 2>
+#include "bloom_hash.h"
+#include "bloom_simd.h"
+#include "utils.h"
+#include "huge_page_alloc.h"
+#include "memory_usage.h"
+
+// The filter is exactly num_bits + class_num bits (plus one spare word) kept in uint64 words.
+// A key of class c sets bit pos + c for each probe pos, so the classes of a probe are the
+// class_num bits starting at pos, read as one 64-bit window straddling two words.
+// double_hashing: the k probes come from one hash of the key, see bloom_hash.h
+template<int num_bits, int k, int class_num = 2, typename Key = uint64_t, bool double_hashing = false>
 class ShiftingBloomFilter
 {
+    static_assert(class_num >= 1 && class_num <= 64, "class_num must be in [1, 64]");
+    typedef ProbeHash<Key, k, double_hashing> Hash;
+
+    static constexpr uint64_t class_mask = class_num == 64 ? ~0ull : (1ull << class_num) - 1;
+    static constexpr uint64_t word_num = (uint64_t(num_bits) + class_num + 63) / 64 + 1;
+
 public:
     constexpr static int _class_num = class_num;
 private:
-    uint32_t bf[num_bits + class_num];
+    uint64_t bf[word_num];
 
-    void insert_bf(uint64_t key, int idx)
+    // the 64 bits starting at bit pos
+    inline uint64_t window(uint64_t pos) const
     {
-        for (int i = 0; i < k; ++i) {
-            int pos = BOB_hashs[i](&key) % num_bits;
-            bf[pos / 32] |= 1u << ((pos + idx) % 32);
-        }
+        uint64_t shift = pos % 64;
+        uint64_t lo = bf[pos / 64] >> shift;
+        uint64_t hi = shift ? bf[pos / 64 + 1] << (64 - shift) : 0;
+        return lo | hi;
     }
 
-    uint32_t query_bf(uint64_t key)
+    void insert_bf(const Key & key, int idx)
     {
-        uint32_t ret = (1u << class_num) - 1;
-        for (int i = 0; i < k; ++i) {
-            int pos = BOB_hashs[i](&key) % num_bits;
-            uint32_t rotate = uint32_t((bf[pos / 32] >> (pos % 32)) | (bf[pos / 32] << (32 - (pos % 32))));
-            ret &= rotate;
-            if (!ret)
-                return 0;
-        }
+        Hash h(key);
+        for_probes<k>([&](auto i) {
+            uint64_t pos = h.template probe<decltype(i)::value>() % num_bits + idx;
+            bf[pos / 64] |= 1ull << (pos % 64);
+            return true;
+        });
+    }
+
+    uint64_t query_bf(const Key & key) const
+    {
+        uint64_t ret = class_mask;
+        Hash h(key);
+        for_probes<k>([&](auto i) {
+            ret &= window(h.template probe<decltype(i)::value>() % num_bits);
+            return ret != 0;
+        });
+        return ret;
+    }
+
+#ifdef __AVX2__
+    // the bit order of the uint64 words is the one of their 32-bit halves, so 32 classes fit in a lane
+    static constexpr bool simd_batch = is_same<Key, uint64_t>::value && class_num <= 32 && num_bits < (1 << 30);
+
+    // query_bf of keys[0 .. 8), one key per lane
+    __m256i query_bf_x8(const uint64_t * keys) const
+    {
+        ProbeHash8<k, double_hashing> h(keys);
+        __m256i ret = _mm256_set1_epi32(uint32_t(class_mask));
+        for_probes<k>([&](auto i) {
+            __m256i pos = simd_mod(h.template probe<decltype(i)::value>(), num_bits);
+            __m256i idx = _mm256_srli_epi32(pos, 5);
+            __m256i shift = _mm256_and_si256(pos, _mm256_set1_epi32(31));
+            __m256i live = simd_live(ret);
+            __m256i lo = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)bf, idx, live, 4);
+            __m256i hi = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)bf,
+                                                     _mm256_add_epi32(idx, _mm256_set1_epi32(1)), live, 4);
+            __m256i item = _mm256_or_si256(_mm256_srlv_epi32(lo, shift),
+                                           _mm256_sllv_epi32(hi, _mm256_sub_epi32(_mm256_set1_epi32(32), shift)));
+            ret = _mm256_and_si256(ret, item);
+            return !_mm256_testz_si256(ret, ret);
+        });
         return ret;
     }
+#else
+    static constexpr bool simd_batch = false;
+#endif
 
 public:
     const string name;
 
+    HUGE_PAGE_NEW
+
     ShiftingBloomFilter() : name("ShiftBF")
     {
         memset(bf, 0, sizeof(bf));
     }
 
-    void insert(uint64_t key, int class_id)
+    // the filter words, as allocated with new
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.query_bytes = sizeof(bf);
+        m.overhead_bytes = huge_alloc_bytes(sizeof(*this)) - sizeof(bf);
+        return m;
+    }
+
+    void insert(const Key & key, int class_id)
     {
         insert_bf(key, class_id);
     }
 
-    int query(uint64_t key)
+    // -1 for no class, -2 for several
+    int query(const Key & key) const
     {
-        int result = -1;
-        uint32_t query_result = query_bf(key);
-
-        for (int i = 0; i < class_num; ++i) {
-            if (query_result & (1u << i)) {
-                if (result != -1) {
-                    return -2;
-                }
-                result = i;
-            }
+        uint64_t query_result = query_bf(key);
+        if (!query_result) {
+            return -1;
         }
+        if (query_result & (query_result - 1)) {
+            return -2;
+        }
+        return __builtin_ctzll(query_result);
+    }
 
-        return result;
+    // query() of keys[0 .. num) into results
+    void query_batch(const Key * keys, int * results, size_t num) const
+    {
+        size_t i = 0;
+#ifdef __AVX2__
+        if constexpr (simd_batch) {
+            for (; i + 8 <= num; i += 8) {
+                _mm256_storeu_si256((__m256i *)(results + i), simd_decode(query_bf_x8(keys + i), -1, -2));
+            }
+        }
+#endif
+        for (; i < num; ++i) {
+            results[i] = query(keys[i]);
+        }
     }
 
-    bool build(KVList & kvs, int num)
+    bool build(KeyValueList<Key> & kvs, int num)
     {
         for (int i = 0; i < num; ++i) {
             insert(kvs[i].first, kvs[i].second);
@@ -71,7 +146,7 @@ public:
         return true;
     }
 
-    bool exp_build(uint64_t * keys, int num)
+    bool exp_build(Key * keys, int num)
     {
         for (int i = 0; i < num / 2; ++i) {
             insert(keys[i], 0);
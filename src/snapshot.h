@@ -0,0 +1,182 @@
+#ifndef COLORINGCLASSIFER_SNAPSHOT_H
+#define COLORINGCLASSIFER_SNAPSHOT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// On-disk snapshot of a ColoringClassifier (native byte order):
+//   SnapshotHeader
+//   payload, checksummed as a whole:
+//     hash seeds, counters
+//     pos/neg edge counts, SnapshotEdge[pos + neg], Key[pos + neg]  (pos edges first)
+//     SnapshotBucket[bucket_num]                          (union-find state and colors)
+//     3 x (uint64 offsets[bucket_num + 1], uint32 ids[]) (per bucket pos edges, neg edges, group neighbours)
+//     overflow count, Key[count], uint32 class[count]
+// Bump SNAPSHOT_VERSION whenever the payload layout changes.
+
+#define SNAPSHOT_VERSION 2
+
+static const char snapshot_magic[8] = {'C', 'C', 'S', 'N', 'A', 'P', 0, 0};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t bucket_num;
+    int32_t color_num;
+    uint32_t key_size;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+struct SnapshotEdge
+{
+    uint32_t hash_val_a;
+    uint32_t hash_val_b;
+    uint32_t available;
+};
+
+struct SnapshotBucket
+{
+    int32_t color;
+    int32_t root_bucket;
+    int32_t next_bucket;    // -1 for NULL
+    int32_t last_son;
+    int32_t group_color;
+};
+
+// FNV-1a over 8-byte words, the tail is folded in byte by byte
+inline uint64_t snapshot_checksum(const char * buf, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, buf + i, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+    for (; i < len; ++i) {
+        h = (h ^ uint8_t(buf[i])) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+class SnapshotWriter
+{
+    vector<char> payload;
+public:
+    template<typename T>
+    void put(const T & val)
+    {
+        put_array(&val, 1);
+    }
+
+    template<typename T>
+    void put_array(const T * vals, size_t num)
+    {
+        const char * p = (const char *)vals;
+        payload.insert(payload.end(), p, p + num * sizeof(T));
+    }
+
+    bool write_file(const char * path, int32_t bucket_num, int32_t color_num, uint32_t key_size) const
+    {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.bucket_num = bucket_num;
+        header.color_num = color_num;
+        header.key_size = key_size;
+        header.payload_size = payload.size();
+        header.checksum = snapshot_checksum(payload.data(), payload.size());
+
+        FILE * f = fopen(path, "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot open %s for writing\n", path);
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(payload.data(), 1, payload.size(), f) == payload.size();
+        ok = (fclose(f) == 0) && ok;
+        return ok;
+    }
+};
+
+class SnapshotReader
+{
+    vector<char> payload;
+    size_t pos;
+    bool ok;
+public:
+    SnapshotReader() : pos(0), ok(false) {}
+
+    // reads the header and the payload in two sequential reads, then checks them
+    bool read_file(const char * path, int32_t bucket_num, int32_t color_num, uint32_t key_size)
+    {
+        ok = false;
+        pos = 0;
+        FILE * f = fopen(path, "rb");
+        if (!f) {
+            fprintf(stderr, "Snapshot %s not found\n", path);
+            return false;
+        }
+
+        SnapshotHeader header;
+        if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0) {
+            fprintf(stderr, "%s is not a snapshot\n", path);
+            fclose(f);
+            return false;
+        }
+        if (header.version != SNAPSHOT_VERSION) {
+            fprintf(stderr, "Snapshot version %u is not supported (expected %u)\n", header.version, SNAPSHOT_VERSION);
+            fclose(f);
+            return false;
+        }
+        if (header.bucket_num != bucket_num || header.color_num != color_num || header.key_size != key_size) {
+            fprintf(stderr, "Snapshot has %d buckets, %d colors and %u-byte keys, expected %d, %d and %u\n",
+                    header.bucket_num, header.color_num, header.key_size, bucket_num, color_num, key_size);
+            fclose(f);
+            return false;
+        }
+
+        payload.resize(header.payload_size);
+        size_t read_size = fread(payload.data(), 1, payload.size(), f);
+        fclose(f);
+        if (read_size != payload.size() || snapshot_checksum(payload.data(), payload.size()) != header.checksum) {
+            fprintf(stderr, "Snapshot %s is truncated or corrupted\n", path);
+            return false;
+        }
+
+        ok = true;
+        return true;
+    }
+
+    template<typename T>
+    bool get(T & val)
+    {
+        return get_array(&val, 1);
+    }
+
+    template<typename T>
+    bool get_array(T * vals, size_t num)
+    {
+        if (!ok || num > (payload.size() - pos) / sizeof(T)) {
+            ok = false;
+            return false;
+        }
+        memcpy((void *)vals, payload.data() + pos, num * sizeof(T));
+        pos += num * sizeof(T);
+        return true;
+    }
+
+    bool done() const
+    {
+        return ok && pos == payload.size();
+    }
+};
+
+#endif //COLORINGCLASSIFER_SNAPSHOT_H
@@ -1,11 +1,22 @@
 #ifndef COLORINGCLASSIFER_UTILS_H
 #define COLORINGCLASSIFER_UTILS_H
 
+#include <cstdint>
+#include <vector>
+#include <string_view>
+
+using namespace std;
+
 constexpr int log2(int n)
 {
     return ((n <= 2) ? 1 : 1 + log2(n / 2));
 }
 
 typedef vector<pair<uint64_t, uint32_t>> KVList;
+// fixed-width keys, see key_types.h
+template<typename Key>
+using KeyValueList = vector<pair<Key, uint32_t>>;
+// str keys are views into storage owned by the caller
+typedef vector<pair<string_view, uint32_t>> StrKVList;
 
 #endif //COLORINGCLASSIFER_UTILS_H
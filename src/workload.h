@@ -0,0 +1,316 @@
+#ifndef COLORINGCLASSIFER_WORKLOAD_H
+#define COLORINGCLASSIFER_WORKLOAD_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "utils.h"
+
+using namespace std;
+
+// how the i-th distinct key is made
+enum KeyOrder
+{
+    KEYS_UNIFORM,      // a random-looking permutation of the key space
+    KEYS_SEQUENTIAL,   // start, start + 1, ...
+};
+
+// how the keys are split into classes
+enum ClassDist
+{
+    CLASSES_ALTERNATING,   // i % class_num, what the tests always used
+    CLASSES_UNIFORM,       // random, equal shares
+    CLASSES_SKEWED,        // random, class c has weight 1 / (c + 1)^class_skew
+};
+
+// which keys a query stream asks for
+enum QueryDist
+{
+    QUERIES_UNIFORM,
+    QUERIES_ZIPF,          // rank r (the r-th key) with probability ~ 1 / r^zipf_s
+    QUERIES_SEQUENTIAL,    // a scan in key order, wrapping around
+};
+
+struct WorkloadSpec
+{
+    uint64_t seed = 1;
+    KeyOrder key_order = KEYS_UNIFORM;
+    // keys are in [0, 2^key_bits); 40 is what the tests drew from before
+    int key_bits = 64;
+    // first key of KEYS_SEQUENTIAL
+    uint64_t start = 0;
+    uint32_t class_num = 2;
+    ClassDist class_dist = CLASSES_ALTERNATING;
+    double class_skew = 1.0;
+};
+
+struct QueryMix
+{
+    QueryDist dist = QUERIES_UNIFORM;
+    double zipf_s = 0.99;
+    // share of queries for member keys, the rest ask for keys that were never generated
+    double hit_rate = 1.0;
+};
+
+// Samples 1..n with P(k) ~ 1 / k^s in O(1), by rejection-inversion (Hoermann & Derflinger 1996),
+// so n can be the whole key set without a table of n probabilities. Any s > 0, including 1.
+class ZipfDistribution
+{
+    uint64_t n;
+    double s;
+    double h_integral_x1, h_integral_n, threshold;
+
+    // log1p(x) / x and expm1(x) / x, continuous at 0
+    static double helper1(double x)
+    {
+        return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x / 2 + x * x / 3;
+    }
+
+    static double helper2(double x)
+    {
+        return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x / 2 + x * x / 6;
+    }
+
+    double h(double x) const
+    {
+        return exp(-s * log(x));
+    }
+
+    // integral of h, shifted so that it is continuous in s at 1
+    double h_integral(double x) const
+    {
+        double log_x = log(x);
+        return helper2((1 - s) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const
+    {
+        double t = x * (1 - s);
+        if (t < -1) {
+            t = -1;
+        }
+        return exp(helper1(t) * x);
+    }
+
+public:
+    ZipfDistribution(uint64_t _n, double _s) : n(max<uint64_t>(_n, 1)), s(_s)
+    {
+        h_integral_x1 = h_integral(1.5) - 1;
+        h_integral_n = h_integral(double(n) + 0.5);
+        threshold = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+    }
+
+    // u01() returns a uniform double in [0, 1)
+    template<typename U01>
+    uint64_t operator()(U01 & u01) const
+    {
+        while (true) {
+            double u = h_integral_n + u01() * (h_integral_x1 - h_integral_n);
+            double x = h_integral_inverse(u);
+            double k = floor(x + 0.5);
+            if (k < 1) {
+                k = 1;
+            } else if (k > double(n)) {
+                k = double(n);
+            }
+            if (k - x <= threshold || u >= h_integral(k + 0.5) - h(k)) {
+                return uint64_t(k);
+            }
+        }
+    }
+};
+
+// Reproducible keys, classes and query streams, for main.cpp and bench.
+// The i-th key is a bijection of i, so keys are distinct without a dedup set and any key can be
+// recomputed from its index; members use the lower half of the indices and absent keys
+// ("aliens", never a member) the upper half. Classes are a hash of (seed, i) as well, so the
+// keys and classes of [begin, end) do not depend on what was generated before.
+class WorkloadGenerator
+{
+    WorkloadSpec spec;
+    uint64_t mask;
+    int half_bits;
+    vector<double> class_cdf;
+
+    static inline uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // a bijection of [0, 2^key_bits): adding a constant, multiplying by an odd constant and
+    // x ^= x >> r are all invertible mod 2^key_bits
+    inline uint64_t permute(uint64_t x) const
+    {
+        x = (x + spec.seed * 0x9e3779b97f4a7c15ull) & mask;
+        x ^= x >> half_bits;
+        x = (x * 0xbf58476d1ce4e5b9ull) & mask;
+        x ^= x >> (half_bits - 1 > 0 ? half_bits - 1 : 1);
+        x = (x * 0x94d049bb133111ebull) & mask;
+        x ^= x >> half_bits;
+        return x;
+    }
+
+    // uniform in [0, 1) from (seed, i, stream)
+    inline double unit(uint64_t i, uint64_t stream) const
+    {
+        return (mix64(mix64(i ^ (stream << 56)) + spec.seed) >> 11) * 0x1.0p-53;
+    }
+
+public:
+    explicit WorkloadGenerator(const WorkloadSpec & _spec = WorkloadSpec()) : spec(_spec)
+    {
+        if (spec.key_bits < 8 || spec.key_bits > 64 || spec.class_num < 1) {
+            fprintf(stderr, "Bad workload spec: %d key bits, %u classes\n", spec.key_bits, spec.class_num);
+            exit(-1);
+        }
+        mask = spec.key_bits == 64 ? ~0ull : (1ull << spec.key_bits) - 1;
+        half_bits = spec.key_bits / 2 + 1;
+        double sum = 0;
+        for (uint32_t c = 0; c < spec.class_num; ++c) {
+            sum += spec.class_dist == CLASSES_SKEWED ? pow(c + 1.0, -spec.class_skew) : 1.0;
+            class_cdf.push_back(sum);
+        }
+        for (double & w: class_cdf) {
+            w /= sum;
+        }
+    }
+
+    const WorkloadSpec & get_spec() const
+    {
+        return spec;
+    }
+
+    // the most members (and aliens) there can be, half the key space
+    uint64_t capacity() const
+    {
+        return (mask >> 1) + 1;
+    }
+
+    // the i-th member key
+    inline uint64_t key(uint64_t i) const
+    {
+        if (spec.key_order == KEYS_SEQUENTIAL) {
+            return (spec.start + i) & mask;
+        }
+        return permute(i);
+    }
+
+    // the i-th key that is never a member, as long as fewer than capacity() members are used
+    inline uint64_t alien(uint64_t i) const
+    {
+        if (spec.key_order == KEYS_SEQUENTIAL) {
+            return (spec.start + capacity() + i) & mask;
+        }
+        return permute(capacity() + i);
+    }
+
+    inline uint32_t class_of(uint64_t i) const
+    {
+        if (spec.class_dist == CLASSES_ALTERNATING) {
+            return uint32_t(i % spec.class_num);
+        }
+        double u = unit(i, 1);
+        return uint32_t(upper_bound(class_cdf.begin(), class_cdf.end() - 1, u) - class_cdf.begin());
+    }
+
+    // members [begin, end) with their classes
+    void append(KVList & kvs, uint64_t begin, uint64_t end) const
+    {
+        kvs.reserve(kvs.size() + (end - begin));
+        for (uint64_t i = begin; i < end; ++i) {
+            kvs.push_back(make_pair(key(i), class_of(i)));
+        }
+    }
+
+    KVList kvs(uint64_t num) const
+    {
+        KVList ret;
+        append(ret, 0, num);
+        return ret;
+    }
+
+    vector<uint64_t> aliens(uint64_t num) const
+    {
+        vector<uint64_t> ret(num);
+        for (uint64_t i = 0; i < num; ++i) {
+            ret[i] = alien(i);
+        }
+        return ret;
+    }
+
+    // num queries over members [0, member_num) and as many aliens; `stream` picks an independent
+    // stream for the same spec. expected, when given, gets the class of each query or -1 for aliens.
+    vector<uint64_t> queries(size_t num, uint64_t member_num, const QueryMix & mix, uint64_t stream = 0,
+                             vector<int> * expected = NULL) const
+    {
+        vector<uint64_t> ret(num);
+        if (expected) {
+            expected->resize(num);
+        }
+        uint64_t counter = 0;
+        auto u01 = [&]() { return unit(counter++, 2 + stream); };
+        ZipfDistribution zipf(member_num, mix.zipf_s);
+        uint64_t scan = 0;
+        for (size_t q = 0; q < num; ++q) {
+            bool hit = u01() < mix.hit_rate;
+            uint64_t i;
+            if (mix.dist == QUERIES_ZIPF) {
+                i = zipf(u01) - 1;
+            } else if (mix.dist == QUERIES_SEQUENTIAL) {
+                i = scan++ % max<uint64_t>(member_num, 1);
+            } else {
+                i = uint64_t(u01() * member_num);
+            }
+            ret[q] = hit ? key(i) : alien(i);
+            if (expected) {
+                (*expected)[q] = hit ? int(class_of(i)) : -1;
+            }
+        }
+        return ret;
+    }
+};
+
+// Removes repeated keys in place, keeping the first of each and the order, with an open
+// addressing table of 2x the keys instead of an unordered_set (a node per key). Returns how
+// many were removed. For key streams not made by WorkloadGenerator, e.g. a real dump.
+inline size_t dedup_keys(vector<uint64_t> & keys)
+{
+    uint64_t cap = 16;
+    while (cap < 2 * keys.size()) {
+        cap *= 2;
+    }
+    // 0 marks an empty slot, the key 0 is tracked on its own
+    vector<uint64_t> table(cap, 0);
+    bool seen_zero = false;
+    size_t n = 0;
+    for (size_t j = 0; j < keys.size(); ++j) {
+        uint64_t key = keys[j];
+        bool fresh;
+        if (key == 0) {
+            fresh = !seen_zero;
+            seen_zero = true;
+        } else {
+            uint64_t s = (key * 0x9e3779b97f4a7c15ull) >> (64 - __builtin_ctzll(cap));
+            while (table[s] != 0 && table[s] != key) {
+                s = (s + 1) & (cap - 1);
+            }
+            fresh = table[s] == 0;
+            table[s] = key;
+        }
+        if (fresh) {
+            keys[n++] = key;
+        }
+    }
+    size_t removed = keys.size() - n;
+    keys.resize(n);
+    return removed;
+}
+
+#endif //COLORINGCLASSIFER_WORKLOAD_H
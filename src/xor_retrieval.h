@@ -0,0 +1,198 @@
+#ifndef COLORINGCLASSIFER_XOR_RETRIEVAL_H
+#define COLORINGCLASSIFER_XOR_RETRIEVAL_H
+
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "BOB_hash.h"
+#include "aligned_array.h"
+#include "memory_usage.h"
+#include "utils.h"
+
+using namespace std;
+
+// Static key -> class retrieval in the style of an XOR filter (Graf & Lemire), as the baseline
+// that solves the GF(2) system instead of coloring it:
+// every key hashes to one slot in each of 3 segments, and the class of a key is the XOR of
+// its 3 slots, each ceil(log2(class_num)) bits wide. build() peels the 3-hypergraph (repeatedly
+// takes a slot that only one key still maps to) and assigns the slots in reverse order.
+// About 1.23 slots per key, so 1.23 * ceil(log2(class_num)) bits per key.
+// It can not tell members from other keys: a key that was not built returns an arbitrary
+// value in [0, 2^ceil(log2(class_num))), never -1 / -2 like the Bloom filters.
+// The size comes from the number of keys, so it is only known after build().
+template<int class_num = 2, typename Key = uint64_t>
+class XorRetrieval
+{
+    // ceil(log2(n)), at least 1; log2() in utils.h rounds down
+    static constexpr int class_bits(int n)
+    {
+        return n <= 2 ? 1 : 1 + class_bits((n + 1) / 2);
+    }
+
+    static constexpr int slot_bits = class_bits(class_num);
+    static constexpr uint64_t slot_mask = (1ull << slot_bits) - 1;
+    static_assert(slot_bits <= 32, "class_num must be less than 2^32");
+
+    // build() tries this many seeds before it gives up
+    static constexpr int max_attempts = 64;
+
+    uint32_t seed1, seed2;
+    // new seeds when the keys do not peel
+    mt19937 rng;
+    uint32_t segment_len;
+    AlignedArray<uint64_t> slots;
+
+    inline uint64_t hash(const Key & key) const
+    {
+        uint32_t h1, h2;
+        BOB_pair(&key, sizeof(Key), seed1, seed2, h1, h2);
+        return (uint64_t(h2) << 32) | h1;
+    }
+
+    // the slot of the key in segment i, from 32 bits of the hash rotated by 21 * i
+    inline uint32_t slot_of(uint64_t h, int i) const
+    {
+        uint64_t r = i == 0 ? h : (h << (21 * i)) | (h >> (64 - 21 * i));
+        return i * segment_len + uint32_t((uint64_t(uint32_t(r)) * segment_len) >> 32);
+    }
+
+    // slot_bits bits of slot i, read from a two-word window (slots may straddle words)
+    inline uint32_t get(uint32_t i) const
+    {
+        uint64_t pos = uint64_t(i) * slot_bits;
+        uint64_t w = pos / 64, shift = pos % 64;
+        uint64_t item = (slots[w] >> shift) | ((slots[w + 1] << 1) << (63 - shift));
+        return uint32_t(item & slot_mask);
+    }
+
+    // slot i is still 0 when it is assigned
+    inline void set(uint32_t i, uint32_t val)
+    {
+        uint64_t pos = uint64_t(i) * slot_bits;
+        uint64_t w = pos / 64, shift = pos % 64;
+        slots[w] |= uint64_t(val) << shift;
+        if (shift + slot_bits > 64) {
+            slots[w + 1] |= uint64_t(val) >> (64 - shift);
+        }
+    }
+
+    // the peeling order of the keys for the current seeds, false if the hypergraph has a 2-core
+    bool peel(const vector<uint64_t> & hashes, vector<uint32_t> & stack_key, vector<uint32_t> & stack_slot) const
+    {
+        uint32_t slot_num = 3 * segment_len;
+        // per slot: the number of keys and the XOR of their indices, so the last key is known
+        vector<uint32_t> count(slot_num, 0), key_xor(slot_num, 0);
+        for (uint32_t j = 0; j < hashes.size(); ++j) {
+            for (int i = 0; i < 3; ++i) {
+                uint32_t s = slot_of(hashes[j], i);
+                count[s]++;
+                key_xor[s] ^= j;
+            }
+        }
+
+        vector<uint32_t> queue;
+        queue.reserve(slot_num);
+        for (uint32_t s = 0; s < slot_num; ++s) {
+            if (count[s] == 1) {
+                queue.push_back(s);
+            }
+        }
+
+        stack_key.clear();
+        stack_slot.clear();
+        for (size_t q = 0; q < queue.size(); ++q) {
+            uint32_t s = queue[q];
+            if (count[s] != 1) {
+                continue;
+            }
+            uint32_t j = key_xor[s];
+            stack_key.push_back(j);
+            stack_slot.push_back(s);
+            for (int i = 0; i < 3; ++i) {
+                uint32_t t = slot_of(hashes[j], i);
+                count[t]--;
+                key_xor[t] ^= j;
+                if (count[t] == 1) {
+                    queue.push_back(t);
+                }
+            }
+        }
+        return stack_key.size() == hashes.size();
+    }
+
+public:
+    const string name;
+    constexpr static int _class_num = class_num;
+
+    explicit XorRetrieval(uint32_t seed = 0) : seed1(BOB_seeds[seed % 32]), seed2(BOB_seeds[(seed + 1) % 32]),
+                                               rng(seed), segment_len(0), slots(1), name("XorRetrieval")
+    {
+    }
+
+    // kvs[0 .. num) must have distinct keys, two equal keys never peel
+    bool build(KeyValueList<Key> & kvs, int num)
+    {
+        segment_len = uint32_t((uint64_t(num) * 123 / 100 + 32 + 2) / 3);
+        uint32_t slot_num = 3 * segment_len;
+
+        vector<uint64_t> hashes(num);
+        vector<uint32_t> stack_key, stack_slot;
+        stack_key.reserve(num);
+        stack_slot.reserve(num);
+
+        for (int attempt = 0; attempt < max_attempts; ++attempt) {
+            for (int j = 0; j < num; ++j) {
+                hashes[j] = hash(kvs[j].first);
+            }
+            if (!peel(hashes, stack_key, stack_slot)) {
+                seed1 = rng();
+                seed2 = rng();
+                continue;
+            }
+
+            AlignedArray<uint64_t> tmp(uint64_t(slot_num) * slot_bits / 64 + 2);
+            slots.swap(tmp);
+            // in reverse peeling order: no key peeled before j maps to the slot j was peeled from,
+            // so setting it leaves their XORs alone
+            for (size_t p = stack_key.size(); p-- > 0; ) {
+                uint32_t j = stack_key[p], s = stack_slot[p];
+                uint32_t val = kvs[j].second & slot_mask;
+                for (int i = 0; i < 3; ++i) {
+                    uint32_t t = slot_of(hashes[j], i);
+                    if (t != s) {
+                        val ^= get(t);
+                    }
+                }
+                set(s, val);
+            }
+            return true;
+        }
+        fprintf(stderr, "XorRetrieval: %d keys did not peel in %d attempts, duplicate keys?\n", num, max_attempts);
+        return false;
+    }
+
+    int query(const Key & key) const
+    {
+        uint64_t h = hash(key);
+        return int(get(slot_of(h, 0)) ^ get(slot_of(h, 1)) ^ get(slot_of(h, 2)));
+    }
+
+    // bytes of the slot array
+    size_t size_bytes() const
+    {
+        return slots.size_bytes();
+    }
+
+    // the slots; the peeling arrays only live during build()
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage m;
+        m.query_bytes = slots.size_bytes();
+        m.overhead_bytes = huge_alloc_bytes(slots.size_bytes()) - slots.size_bytes() + sizeof(*this);
+        return m;
+    }
+};
+
+#endif //COLORINGCLASSIFER_XOR_RETRIEVAL_H